@@ -11,160 +11,2164 @@
 
 #include "genltest.h"
 
+#include <linux/atomic.h>
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/fs.h>
+#include <linux/hrtimer.h>
+#include <linux/jump_label.h>
+#include <linux/miscdevice.h>
+#include <linux/kthread.h>
+#include <linux/llist.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/nsproxy.h>
+#include <linux/percpu.h>
+#include <linux/poll.h>
+#include <linux/random.h>
+#include <linux/sched/task.h>
+#include <linux/seq_file.h>
+#include <linux/sizes.h>
+#include <linux/slab.h>
+#include <linux/topology.h>
+#include <linux/u64_stats_sync.h>
+#include <linux/uio.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 #include <net/genetlink.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+
+#define CREATE_TRACE_POINTS
+#include "genltest_trace.h"
+
+/*
+ * Some materials that were used as source for this example/tutorial/guide:
+ *
+ * - https://wiki.linuxfoundation.org/networking/generic_netlink_howto
+ * - https://kernel.org/doc/html/next/userspace-api/netlink/intro.html
+ */
+
+/*
+ * Longest string that can be pinged to the multicast group. The length of an
+ * attribute is 16 bits, and it has to fit its header and the NUL.
+ */
+#define MSG_MAX_LEN_LIMIT (U16_MAX - NLA_HDRLEN - 1)
+
+static unsigned int msg_max_len = 1024;
+
+static int msg_max_len_set(const char *val, const struct kernel_param *kp)
+{
+	return param_set_uint_minmax(val, kp, 1, MSG_MAX_LEN_LIMIT);
+}
+
+static const struct kernel_param_ops msg_max_len_ops = {
+	.set = msg_max_len_set,
+	.get = param_get_uint,
+};
+
+module_param_cb(msg_max_len, &msg_max_len_ops, &msg_max_len, 0644);
+MODULE_PARM_DESC(msg_max_len, "Longest message that can be pinged, in bytes");
+
+static bool async_ping;
+module_param(async_ping, bool, 0644);
+MODULE_PARM_DESC(async_ping,
+		 "Queue pings and multicast them from a workqueue, coalesced");
+
+/* What we reply to GENLTEST_CMD_ECHO */
+#define ECHO_REPLY_MSG "Hello from Kernel Space, Netlink!"
+
+/* Records sent in a GENLTEST_CMD_ECHO dump if the client doesn't say */
+#define DUMP_DEFAULT_COUNT 16
+#define DUMP_MSG_LEN	   64
+
+/* Forward declaration */
+static struct genl_family genl_fam;
+
+/*
+ * Per-CPU statistics, indexed by their attribute type. Each CPU only updates
+ * its own counters so there's no need for any lock nor atomic operation, and
+ * readers use the u64_stats_sync (which is a no-op on 64-bit) to get a
+ * consistent view of them even on 32-bit.
+ */
+struct genltest_stats {
+	u64_stats_t	      cnt[__GENLTEST_STATS_A_MAX];
+	struct u64_stats_sync syncp;
+};
+
+static DEFINE_PER_CPU(struct genltest_stats, genltest_stats);
+
+/* Add val to one of the counters of the current CPU */
+static void stats_add(int type, u64 val)
+{
+	/* Don't let us be moved to another CPU in the middle of the update */
+	struct genltest_stats *stats = get_cpu_ptr(&genltest_stats);
+
+	u64_stats_update_begin(&stats->syncp);
+	u64_stats_add(&stats->cnt[type], val);
+	u64_stats_update_end(&stats->syncp);
+
+	put_cpu_ptr(&genltest_stats);
+}
+
+static inline void stats_inc(int type)
+{
+	stats_add(type, 1);
+}
+
+/* Count a failure to create a message */
+static inline void stats_err(int err)
+{
+	if (err == -ENOMEM) {
+		stats_inc(GENLTEST_STATS_A_ENOMEM);
+	} else if (err == -EMSGSIZE) {
+		stats_inc(GENLTEST_STATS_A_EMSGSIZE);
+	}
+}
+
+/* Sum up the counters of all CPUs into sum */
+static void stats_read(u64 sum[__GENLTEST_STATS_A_MAX])
+{
+	int i, cpu;
+
+	memset(sum, 0, sizeof(u64) * __GENLTEST_STATS_A_MAX);
+
+	for_each_possible_cpu(cpu) {
+		const struct genltest_stats *stats =
+			per_cpu_ptr(&genltest_stats, cpu);
+		u64	     cnt[__GENLTEST_STATS_A_MAX];
+		unsigned int start;
+
+		do {
+			start = u64_stats_fetch_begin(&stats->syncp);
+			for (i = 0; i < __GENLTEST_STATS_A_MAX; i++) {
+				cnt[i] = u64_stats_read(&stats->cnt[i]);
+			}
+		} while (u64_stats_fetch_retry(&stats->syncp, start));
+
+		for (i = 0; i < __GENLTEST_STATS_A_MAX; i++) {
+			sum[i] += cnt[i];
+		}
+	}
+}
+
+static void stats_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		u64_stats_init(&per_cpu_ptr(&genltest_stats, cpu)->syncp);
+	}
+}
+
+/*
+ * Latency histograms of the stages of the hot paths, to see where the time
+ * goes inside of the module, which user space can only measure as a whole.
+ * They are off unless the latency_hist param is set, and while off all they
+ * cost is a static key, a nop in place of a branch, at each of the stages.
+ * Once on, each stage takes a ktime_get_ns() and adds the time since the last
+ * one to a log2 bucket of its CPU.
+ */
+enum lat_stage {
+	/* Allocation of the echo reply, or copy of its template */
+	LAT_ECHO_ALLOC,
+	/* Putting its header and attributes */
+	LAT_ECHO_FILL,
+	/* genlmsg_reply() */
+	LAT_ECHO_REPLY,
+	/* Building a ping message, coalesced or not */
+	LAT_PING_BUILD,
+	/* genlmsg_multicast_netns(), the fan-out to all of the listeners */
+	LAT_PING_MCAST,
+	__LAT_STAGES,
+};
+
+static const char *const lat_names[__LAT_STAGES] = {
+	[LAT_ECHO_ALLOC] = "echo_alloc",
+	[LAT_ECHO_FILL]	 = "echo_fill",
+	[LAT_ECHO_REPLY] = "echo_reply",
+	[LAT_PING_BUILD] = "ping_build",
+	[LAT_PING_MCAST] = "ping_mcast",
+};
+
+/*
+ * Per-CPU, like the statistics. Bucket i of a stage counts the samples from
+ * 2^i to 2^(i + 1) - 1 ns, the first one also 0 and the last one everything
+ * longer, around 2 s on.
+ */
+struct lat_hist {
+	u64_stats_t	      bucket[__LAT_STAGES][GENLTEST_LATENCY_BUCKETS];
+	u64_stats_t	      sum[__LAT_STAGES];
+	struct u64_stats_sync syncp;
+};
+
+static DEFINE_PER_CPU(struct lat_hist, lat_hists);
+static DEFINE_STATIC_KEY_FALSE(lat_enabled);
+
+static bool latency_hist;
+
+static int latency_hist_set(const char *val, const struct kernel_param *kp)
+{
+	int ret = param_set_bool(val, kp);
+
+	if (ret) {
+		return ret;
+	}
+	/* Writes to a param are serialized, so the key follows the last one */
+	if (latency_hist) {
+		static_branch_enable(&lat_enabled);
+	} else {
+		static_branch_disable(&lat_enabled);
+	}
+
+	return 0;
+}
+
+static const struct kernel_param_ops latency_hist_ops = {
+	.set = latency_hist_set,
+	.get = param_get_bool,
+};
+
+module_param_cb(latency_hist, &latency_hist_ops, &latency_hist, 0644);
+MODULE_PARM_DESC(latency_hist,
+		 "Keep latency histograms of the hot paths, in debugfs");
+
+/* Add a sample of ns to the histogram of stage of the current CPU */
+static noinline void lat_record(enum lat_stage stage, u64 ns)
+{
+	struct lat_hist *h = get_cpu_ptr(&lat_hists);
+	unsigned int	 i = ns ? min_t(unsigned int, ilog2(ns),
+					GENLTEST_LATENCY_BUCKETS - 1) :
+				  0;
+
+	u64_stats_update_begin(&h->syncp);
+	u64_stats_inc(&h->bucket[stage][i]);
+	u64_stats_add(&h->sum[stage], ns);
+	u64_stats_update_end(&h->syncp);
+
+	put_cpu_ptr(&lat_hists);
+}
+
+/* When a stage starts, or 0 if the histograms are off */
+static __always_inline u64 lat_start(void)
+{
+	return static_branch_unlikely(&lat_enabled) ? ktime_get_ns() : 0;
+}
+
+/*
+ * End stage, which started at start, and return the time, for the next stage
+ * to start at. Nothing is recorded if the histograms were off when it started.
+ */
+static __always_inline u64 lat_stamp(enum lat_stage stage, u64 start)
+{
+	u64 now;
+
+	if (!static_branch_unlikely(&lat_enabled) || !start) {
+		return 0;
+	}
+	now = ktime_get_ns();
+	lat_record(stage, now - start);
+
+	return now;
+}
+
+/* Histogram of a stage, summed up for all CPUs */
+struct lat_snap {
+	u64 count;
+	u64 sum;
+	u64 bucket[GENLTEST_LATENCY_BUCKETS];
+};
+
+/*
+ * Read the histogram of stage. Only each counter on its own is consistent,
+ * there's no point in more with samples still coming in from other CPUs.
+ */
+static void lat_read(enum lat_stage stage, struct lat_snap *snap)
+{
+	int i, cpu;
+
+	memset(snap, 0, sizeof(*snap));
+
+	for_each_possible_cpu(cpu) {
+		const struct lat_hist *h = per_cpu_ptr(&lat_hists, cpu);
+		unsigned int	       start;
+		u64		       val;
+
+		for (i = 0; i < GENLTEST_LATENCY_BUCKETS; i++) {
+			do {
+				start = u64_stats_fetch_begin(&h->syncp);
+				val   = u64_stats_read(&h->bucket[stage][i]);
+			} while (u64_stats_fetch_retry(&h->syncp, start));
+			snap->bucket[i] += val;
+			snap->count += val;
+		}
+		do {
+			start = u64_stats_fetch_begin(&h->syncp);
+			val   = u64_stats_read(&h->sum[stage]);
+		} while (u64_stats_fetch_retry(&h->syncp, start));
+		snap->sum += val;
+	}
+}
+
+static void lat_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		u64_stats_init(&per_cpu_ptr(&lat_hists, cpu)->syncp);
+	}
+}
+
+/*
+ * debugfs file with the histograms, genltest/latency. Each stage with samples
+ * gets a "name count N sum_ns N" line, then one line for each of its buckets
+ * that isn't empty, with the range of ns that it covers and its count.
+ */
+static int lat_show(struct seq_file *m, void *v)
+{
+	struct lat_snap snap;
+	int		stage, i;
+
+	for (stage = 0; stage < __LAT_STAGES; stage++) {
+		lat_read(stage, &snap);
+		if (!snap.count) {
+			continue;
+		}
+		seq_printf(m, "%s count %llu sum_ns %llu\n", lat_names[stage],
+			   snap.count, snap.sum);
+		for (i = 0; i < GENLTEST_LATENCY_BUCKETS; i++) {
+			if (!snap.bucket[i]) {
+				continue;
+			}
+			seq_printf(m, "  [%llu, %llu) %llu\n",
+				   i ? 1ULL << i : 0, 1ULL << (i + 1),
+				   snap.bucket[i]);
+		}
+	}
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(lat);
+
+static struct dentry *lat_dir;
+
+/* Like the rest of debugfs, nothing to do if it fails */
+static void lat_debugfs_init(void)
+{
+	lat_dir = debugfs_create_dir("genltest", NULL);
+	debugfs_create_file("latency", 0444, lat_dir, NULL, &lat_fops);
+}
+
+/* Room for the GENLTEST_A_LATENCY nest of each stage */
+static size_t lat_nla_size(void)
+{
+	size_t size = 0;
+	int    stage;
+
+	for (stage = 0; stage < __LAT_STAGES; stage++) {
+		size += nla_total_size(
+			nla_total_size(strlen(lat_names[stage]) + 1) +
+			2 * nla_total_size_64bit(sizeof(u64)) +
+			nla_total_size(sizeof_field(struct lat_snap, bucket)));
+	}
+
+	return size;
+}
+
+/* Put a GENLTEST_A_LATENCY nest into msg for each stage with samples */
+static int lat_nla_put(struct sk_buff *msg)
+{
+	struct lat_snap snap;
+	struct nlattr  *nest;
+	int		stage;
+
+	for (stage = 0; stage < __LAT_STAGES; stage++) {
+		lat_read(stage, &snap);
+		if (!snap.count) {
+			continue;
+		}
+		nest = nla_nest_start(msg, GENLTEST_A_LATENCY);
+		if (!nest ||
+		    nla_put_string(msg, GENLTEST_LATENCY_A_STAGE,
+				   lat_names[stage]) ||
+		    nla_put_u64_64bit(msg, GENLTEST_LATENCY_A_COUNT, snap.count,
+				      GENLTEST_LATENCY_A_PAD) ||
+		    nla_put_u64_64bit(msg, GENLTEST_LATENCY_A_SUM, snap.sum,
+				      GENLTEST_LATENCY_A_PAD) ||
+		    nla_put(msg, GENLTEST_LATENCY_A_BUCKETS,
+			    sizeof(snap.bucket), snap.bucket)) {
+			return -EMSGSIZE;
+		}
+		nla_nest_end(msg, nest);
+	}
+
+	return 0;
+}
+
+/*
+ * The reply to GENLTEST_CMD_ECHO is always the same, so it's built only once
+ * when the module is loaded, and then copied for each request.
+ */
+static struct sk_buff *echo_reply_tmpl;
+
+static int __init echo_reply_tmpl_init(void)
+{
+	void	       *hdr;
+	/* Just enough room for the header and the string */
+	struct sk_buff *skb =
+		genlmsg_new(nla_total_size(sizeof(ECHO_REPLY_MSG)), GFP_KERNEL);
+
+	if (!skb) {
+		return -ENOMEM;
+	}
+
+	/*
+	 * The family doesn't have an id until it's registered, echo_doit()
+	 * fills it in along with the portid and sequence number of the request.
+	 */
+	hdr = genlmsg_put(skb, 0, 0, &genl_fam, 0, GENLTEST_CMD_ECHO);
+	if (!hdr || nla_put_string(skb, GENLTEST_A_MSG, ECHO_REPLY_MSG)) {
+		nlmsg_free(skb);
+		return -EMSGSIZE;
+	}
+	genlmsg_end(skb, hdr);
+
+	echo_reply_tmpl = skb;
+
+	return 0;
+}
+
+/* Reply to GENLTEST_CMD_ECHO requests without binary data */
+static struct sk_buff *echo_tmpl_reply(struct genl_info *info)
+{
+	struct nlmsghdr *nlh;
+	u64		 t = lat_start();
+	/*
+	 * Copy the prebuilt reply. A clone would be cheaper, but it would share
+	 * the data with the template, and we need to change the header.
+	 */
+	struct sk_buff	*msg = skb_copy(echo_reply_tmpl, GFP_KERNEL);
+
+	if (!msg) {
+		return ERR_PTR(-ENOMEM);
+	}
+	t = lat_stamp(LAT_ECHO_ALLOC, t);
+
+	/* Address it to whoever sent the request */
+	nlh		= nlmsg_hdr(msg);
+	nlh->nlmsg_type = genl_fam.id;
+	nlh->nlmsg_pid	= info->snd_portid;
+	nlh->nlmsg_seq	= info->snd_seq;
+	lat_stamp(LAT_ECHO_FILL, t);
+
+	return msg;
+}
+
+/*
+ * Reply to GENLTEST_CMD_ECHO requests with binary data, which is echoed back.
+ * The data goes straight from the request into the reply, with a single copy
+ * and without having to look for any NUL.
+ */
+static struct sk_buff *echo_data_reply(struct genl_info   *info,
+				       const struct nlattr *data)
+{
+	void	       *hdr;
+	u64		t   = lat_start();
+	struct sk_buff *msg = genlmsg_new(nla_total_size(nla_len(data)),
+					  GFP_KERNEL);
+
+	if (!msg) {
+		return ERR_PTR(-ENOMEM);
+	}
+	t = lat_stamp(LAT_ECHO_ALLOC, t);
+
+	hdr = genlmsg_put(msg, info->snd_portid, info->snd_seq, &genl_fam, 0,
+			  GENLTEST_CMD_ECHO);
+	if (!hdr ||
+	    nla_put(msg, GENLTEST_A_DATA, nla_len(data), nla_data(data))) {
+		nlmsg_free(msg);
+		return ERR_PTR(-EMSGSIZE);
+	}
+	genlmsg_end(msg, hdr);
+	lat_stamp(LAT_ECHO_FILL, t);
+
+	return msg;
+}
+
+/*
+ * Handler for GENLTEST_CMD_ECHO messages received. Errors are told to the
+ * sender through the extended ACK, which costs just storing a pointer to a
+ * string, instead of being logged.
+ */
+static int echo_doit(struct sk_buff *skb, struct genl_info *info)
+{
+	int		ret = 0;
+	size_t		len;
+	u64		t;
+	struct nlattr  *data = info->attrs[GENLTEST_A_DATA];
+	struct nlattr  *str  = info->attrs[GENLTEST_A_MSG];
+	struct sk_buff *msg;
+
+	/*
+	 * Trace the received message. The attributes are optional, in which
+	 * case it's just an empty message.
+	 */
+	trace_genltest_echo_recv(info->snd_portid, GENLTEST_CMD_ECHO,
+				 data ? nla_len(data) : str ? nla_len(str) : 0);
+	if (data && str) {
+		NL_SET_ERR_MSG_ATTR(info->extack, data,
+				    "data and msg can't go together");
+		return -EINVAL;
+	}
+
+	/* Nothing to build, the sender only wants to hear about errors */
+	if (info->attrs[GENLTEST_A_NOREPLY]) {
+		stats_inc(GENLTEST_STATS_A_ECHO);
+		stats_add(GENLTEST_STATS_A_RX_BYTES, info->nlhdr->nlmsg_len);
+		return 0;
+	}
+
+	/* Binary data is echoed back, anything else gets the usual reply */
+	msg = data ? echo_data_reply(info, data) : echo_tmpl_reply(info);
+	if (IS_ERR(msg)) {
+		ret = PTR_ERR(msg);
+		NL_SET_ERR_MSG(info->extack, "failed to create echo reply");
+		stats_err(ret);
+		return ret;
+	}
+
+	/* And send it */
+	len = msg->len;
+	t   = lat_start();
+	ret = genlmsg_reply(msg, info);
+	lat_stamp(LAT_ECHO_REPLY, t);
+	trace_genltest_echo_reply(info->snd_portid, len, ret);
+	if (!ret) {
+		stats_inc(GENLTEST_STATS_A_ECHO);
+		stats_add(GENLTEST_STATS_A_RX_BYTES, info->nlhdr->nlmsg_len);
+		stats_add(GENLTEST_STATS_A_TX_BYTES, len);
+	}
+
+	return ret;
+}
+
+/*
+ * State of a GENLTEST_CMD_ECHO dump, kept in netlink_callback->ctx in between
+ * calls to echo_dumpit().
+ */
+struct echo_dump_ctx {
+	u32 idx;
+	u32 count;
+};
+
+static inline struct echo_dump_ctx *echo_dump_ctx(struct netlink_callback *cb)
+{
+	BUILD_BUG_ON(sizeof(struct echo_dump_ctx) > sizeof(cb->ctx));
+	return (struct echo_dump_ctx *)cb->ctx;
+}
+
+/*
+ * Called once at the beginning of a GENLTEST_CMD_ECHO dump. The request has
+ * already been parsed and strictly validated against the policy of the op by
+ * genetlink, just like for doit.
+ */
+static int echo_dump_start(struct netlink_callback *cb)
+{
+	struct nlattr	    **attrs = genl_info_dump(cb)->attrs;
+	struct echo_dump_ctx *ctx   = echo_dump_ctx(cb);
+
+	/* Find out how many records the client wants */
+	ctx->idx   = 0;
+	ctx->count = attrs[GENLTEST_A_COUNT] ?
+			     nla_get_u32(attrs[GENLTEST_A_COUNT]) :
+			     DUMP_DEFAULT_COUNT;
+
+	stats_add(GENLTEST_STATS_A_RX_BYTES, cb->nlh->nlmsg_len);
+
+	return 0;
+}
+
+/*
+ * Called repeatedly until the dump is over. Each time we fill the skb that
+ * we're given with as many records as fit in, and the cursor in the context
+ * remembers where to continue from the next time.
+ */
+static int echo_dumpit(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	void		     *hdr;
+	char		      str[DUMP_MSG_LEN];
+	struct echo_dump_ctx *ctx   = echo_dump_ctx(cb);
+	u32		      first = ctx->idx;
+
+	for (; ctx->idx < ctx->count; ctx->idx++) {
+		hdr = genlmsg_put(skb, NETLINK_CB(cb->skb).portid,
+				  cb->nlh->nlmsg_seq, &genl_fam, NLM_F_MULTI,
+				  GENLTEST_CMD_ECHO);
+		if (!hdr) {
+			break;
+		}
+
+		snprintf(str, sizeof(str), ECHO_REPLY_MSG " #%u", ctx->idx);
+		if (nla_put_string(skb, GENLTEST_A_MSG, str)) {
+			/* No more room, this one goes into the next skb */
+			genlmsg_cancel(skb, hdr);
+			break;
+		}
+
+		genlmsg_end(skb, hdr);
+	}
+
+	stats_add(GENLTEST_STATS_A_ECHO, ctx->idx - first);
+	stats_add(GENLTEST_STATS_A_TX_BYTES, skb->len);
+
+	/* Once nothing more is put in the skb the dump is finished */
+	return skb->len;
+}
+
+/*
+ * Called once the dump is finished or aborted. The cursor lives inside of the
+ * callback itself, so there's nothing to release.
+ */
+static int echo_dump_done(struct netlink_callback *cb)
+{
+	return 0;
+}
+
+/*
+ * Handler for GENLTEST_CMD_ECHO_BATCH messages received. Every GENLTEST_A_MSG
+ * or GENLTEST_A_DATA inside of the GENLTEST_A_BATCH nest is echoed back, all of
+ * them in a single reply, so that the client pays for one round trip and one
+ * skb instead of N.
+ */
+static int echo_batch_doit(struct sk_buff *skb, struct genl_info *info)
+{
+	int		ret = 0, rem;
+	size_t		size = 0, len;
+	unsigned int	n = 0;
+	void	       *hdr;
+	struct nlattr  *batch = info->attrs[GENLTEST_A_BATCH], *nla, *nest;
+	struct sk_buff *msg;
+
+	trace_genltest_echo_recv(info->snd_portid, GENLTEST_CMD_ECHO_BATCH,
+				 batch ? nla_len(batch) : 0);
+	if (GENL_REQ_ATTR_CHECK(info, GENLTEST_A_BATCH)) {
+		return -EINVAL;
+	}
+
+	/*
+	 * Walk the batch once to know exactly how big the reply is going to be,
+	 * the policy has already made sure that all entries are valid. Entries
+	 * keep their type, so strings and binary data can be mixed.
+	 */
+	nla_for_each_nested(nla, batch, rem) {
+		size += nla_total_size(nla_len(nla));
+		n++;
+	}
+
+	/* Allocate a buffer big enough for all of the echoed messages */
+	msg = genlmsg_new(nla_total_size(size), GFP_KERNEL);
+	if (!msg) {
+		NL_SET_ERR_MSG(info->extack, "failed to allocate batch reply");
+		stats_inc(GENLTEST_STATS_A_ENOMEM);
+		return -ENOMEM;
+	}
+
+	/* Put the Generic Netlink header */
+	hdr = genlmsg_put(msg, info->snd_portid, info->snd_seq, &genl_fam, 0,
+			  GENLTEST_CMD_ECHO_BATCH);
+	if (!hdr) {
+		NL_SET_ERR_MSG(info->extack,
+			       "failed to create genetlink header");
+		stats_inc(GENLTEST_STATS_A_EMSGSIZE);
+		nlmsg_free(msg);
+		return -EMSGSIZE;
+	}
+
+	/* And the messages, inside of a nest just like in the request */
+	nest = nla_nest_start(msg, GENLTEST_A_BATCH);
+	if (!nest) {
+		ret = -EMSGSIZE;
+		goto err;
+	}
+	nla_for_each_nested(nla, batch, rem) {
+		if ((ret = nla_put(msg, nla_type(nla), nla_len(nla),
+				   nla_data(nla)))) {
+			goto err;
+		}
+	}
+	nla_nest_end(msg, nest);
+
+	/* Finalize the message and send it */
+	genlmsg_end(msg, hdr);
+
+	len = msg->len;
+	ret = genlmsg_reply(msg, info);
+	trace_genltest_echo_reply(info->snd_portid, len, ret);
+	if (!ret) {
+		stats_add(GENLTEST_STATS_A_ECHO, n);
+		stats_add(GENLTEST_STATS_A_RX_BYTES, info->nlhdr->nlmsg_len);
+		stats_add(GENLTEST_STATS_A_TX_BYTES, len);
+	}
+
+	return ret;
+
+err:
+	NL_SET_ERR_MSG(info->extack, "failed to create batch reply");
+	stats_err(ret);
+	genlmsg_cancel(msg, hdr);
+	nlmsg_free(msg);
+	return ret;
+}
+
+/* Handler for GENLTEST_CMD_GET_STATS messages received */
+static int get_stats_doit(struct sk_buff *skb, struct genl_info *info)
+{
+	int		i;
+	u64		sum[__GENLTEST_STATS_A_MAX];
+	void	       *hdr;
+	struct nlattr  *nest;
+	struct sk_buff *msg;
+
+	stats_read(sum);
+
+	/* Room for a nest with all of the counters, and the histograms */
+	msg = genlmsg_new(nla_total_size(GENLTEST_STATS_A_MAX *
+					 nla_total_size_64bit(sizeof(u64))) +
+				  lat_nla_size(),
+			  GFP_KERNEL);
+	if (!msg) {
+		NL_SET_ERR_MSG(info->extack, "failed to allocate stats reply");
+		stats_inc(GENLTEST_STATS_A_ENOMEM);
+		return -ENOMEM;
+	}
+
+	/* Put the Generic Netlink header */
+	hdr = genlmsg_put(msg, info->snd_portid, info->snd_seq, &genl_fam, 0,
+			  GENLTEST_CMD_GET_STATS);
+	if (!hdr) {
+		goto err_free;
+	}
+
+	/* And all of the counters, 64-bit aligned */
+	nest = nla_nest_start(msg, GENLTEST_A_STATS);
+	if (!nest) {
+		goto err_cancel;
+	}
+	for (i = GENLTEST_STATS_A_PAD + 1; i <= GENLTEST_STATS_A_MAX; i++) {
+		if (nla_put_u64_64bit(msg, i, sum[i], GENLTEST_STATS_A_PAD)) {
+			goto err_cancel;
+		}
+	}
+	nla_nest_end(msg, nest);
+	if (lat_nla_put(msg)) {
+		goto err_cancel;
+	}
+
+	/* Finalize the message and send it */
+	genlmsg_end(msg, hdr);
+
+	return genlmsg_reply(msg, info);
+
+err_cancel:
+	genlmsg_cancel(msg, hdr);
+err_free:
+	NL_SET_ERR_MSG(info->extack, "failed to create stats reply");
+	stats_inc(GENLTEST_STATS_A_EMSGSIZE);
+	nlmsg_free(msg);
+	return -EMSGSIZE;
+}
+
+/*
+ * Policies, ops and multicast groups of our Generic Netlink family, along with
+ * the names of the counters as shown in sysfs, all generated from the spec of
+ * the family, spec/genltest.yaml. The ring op is along with the rest of the
+ * rings, further down.
+ */
+#include "genltest_nl_kern.h"
+
+/*
+ * Generic Netlink family.
+ *
+ * None of our handlers need genl_mutex, so we let the ops run in parallel: the
+ * echo reply template is only written before registering the family, the
+ * statistics are per-CPU, the dump cursor lives in the netlink callback of
+ * each socket and the multicast sequence number is atomic. Errors in the
+ * handlers are told to the sender in extended ACKs instead of being logged,
+ * so that a storm of them doesn't serialize all CPUs behind the console lock
+ * either.
+ *
+ * None of the ops sets GENL_DONT_VALIDATE_STRICT or
+ * GENL_DONT_VALIDATE_DUMP_STRICT, and resv_start_op is left at 0, so that
+ * requests are validated as strictly as it gets: unknown attributes, trailing
+ * data and a non-zero reserved field in the genl header are all rejected,
+ * with the offending attribute pointed out in the extended ACK.
+ */
+static struct genl_family genl_fam = {
+	.name	      = GENLTEST_GENL_NAME,
+	.version      = GENLTEST_GENL_VERSION,
+	.maxattr      = GENLTEST_A_MAX,
+	.netnsok      = true,
+	.parallel_ops = true,
+	.ops	      = genltest_nl_ops,
+	.n_ops	      = ARRAY_SIZE(genltest_nl_ops),
+	.mcgrps	      = genltest_nl_mcgrps,
+	.n_mcgrps     = ARRAY_SIZE(genltest_nl_mcgrps),
+};
+
+/*
+ * State of each network namespace. Notifications are only multicast to the
+ * namespace they come from, so each one has its own sequence numbers.
+ */
+struct genltest_net {
+	/* Sequence number of the next multicast message of each group */
+	atomic_t   ping_seq[__GENLTEST_MCGRP_MAX];
+	/* State of the rate limiter of each group, see ping_admit() */
+	atomic64_t ping_tat[__GENLTEST_MCGRP_MAX];
+};
+
+static unsigned int genltest_net_id;
+
+static void ring_net_exit(struct net *net);
+
+/*
+ * The state is allocated and zeroed by the core. A namespace going away only
+ * has to let go of the rings, if they are its.
+ */
+static struct pernet_operations genltest_net_ops = {
+	.id   = &genltest_net_id,
+	.size = sizeof(struct genltest_net),
+	.exit = ring_net_exit,
+};
+
+/* Namespace of whoever is pinging, i.e. of the writer of the sysfs attrs */
+static inline struct net *ping_net(void)
+{
+	return current->nsproxy->net_ns;
+}
+
+/* Multicast group that the ping sysfs attr sends to */
+static unsigned int ping_group = GENLTEST_MCGRP_DEFAULT;
+
+/*
+ * Build the multicast message for a ping of cnt bytes from buf to group with
+ * sequence number seq, in a single linear buffer. Big ones may not find enough
+ * contiguous memory for it, so they don't insist nor complain.
+ */
+static struct sk_buff *ping_msg_new(unsigned int group, u32 seq,
+				    const char *buf, size_t cnt)
+{
+	void	       *hdr;
+	struct nlattr  *nla;
+	size_t		size = 2 * nla_total_size(sizeof(u32)) +
+			       nla_total_size(cnt + 1);
+	/* Allocate a buffer just big enough for the group, seq and string */
+	struct sk_buff *skb = genlmsg_new(size, size > PAGE_SIZE ?
+					  GFP_KERNEL | __GFP_NOWARN |
+						  __GFP_NORETRY :
+					  GFP_KERNEL);
+
+	if (unlikely(!skb)) {
+		return ERR_PTR(-ENOMEM);
+	}
+
+	/* Put the Generic Netlink header, the group and the sequence number */
+	hdr = genlmsg_put(skb, 0, 0, &genl_fam, 0, GENLTEST_CMD_ECHO);
+	if (unlikely(!hdr || nla_put_u32(skb, GENLTEST_A_MCGRP, group) ||
+		     nla_put_u32(skb, GENLTEST_A_SEQ, seq))) {
+		goto err;
+	}
+
+	/*
+	 * And the message. buf is not necessarily NUL terminated at cnt, so
+	 * copy exactly cnt bytes and terminate it ourselves.
+	 */
+	nla = nla_reserve(skb, GENLTEST_A_MSG, cnt + 1);
+	if (unlikely(!nla)) {
+		goto err;
+	}
+	memcpy(nla_data(nla), buf, cnt);
+	((char *)nla_data(nla))[cnt] = '\0';
+
+	/* Finalize the message */
+	genlmsg_end(skb, hdr);
+
+	return skb;
+
+err:
+	nlmsg_free(skb);
+	return ERR_PTR(-EMSGSIZE);
+}
+
+/*
+ * Same as ping_msg_new(), but with the string in page fragments, which only
+ * need order-0 pages. The headers still go in the linear part, where they can
+ * be parsed directly.
+ */
+static struct sk_buff *ping_msg_new_paged(unsigned int group, u32 seq,
+					  const char *buf, size_t cnt)
+{
+	static const char zero[NLA_ALIGNTO];
+	int		  err;
+	unsigned int	  off;
+	void		 *hdr;
+	struct nlattr	 *nla;
+	size_t		  data_len = NLA_ALIGN(cnt + 1);
+	struct sk_buff	 *skb = alloc_skb_with_frags(
+		nlmsg_total_size(GENL_HDRLEN + 2 * nla_total_size(sizeof(u32)) +
+				 NLA_HDRLEN),
+		data_len, 0, &err, GFP_KERNEL);
+
+	if (unlikely(!skb)) {
+		return ERR_PTR(err);
+	}
+
+	/* The headers go first, while the skb is still linear */
+	hdr = genlmsg_put(skb, 0, 0, &genl_fam, 0, GENLTEST_CMD_ECHO);
+	if (unlikely(!hdr || nla_put_u32(skb, GENLTEST_A_MCGRP, group) ||
+		     nla_put_u32(skb, GENLTEST_A_SEQ, seq))) {
+		goto err;
+	}
+	nla	      = skb_put(skb, NLA_HDRLEN);
+	nla->nla_type = GENLTEST_A_MSG;
+	nla->nla_len  = NLA_HDRLEN + cnt + 1;
+
+	/* Then the string, its NUL and the padding, into the frags */
+	off = skb->len;
+	skb->len += data_len;
+	skb->data_len += data_len;
+	if (unlikely(skb_store_bits(skb, off, buf, cnt) ||
+		     skb_store_bits(skb, off + cnt, zero, data_len - cnt))) {
+		goto err;
+	}
+
+	/* genlmsg_end() would only count the linear part */
+	nlmsg_hdr(skb)->nlmsg_len = skb->len;
+
+	return skb;
+
+err:
+	kfree_skb(skb);
+	return ERR_PTR(-EMSGSIZE);
+}
+
+/*
+ * Send a ping message with cnt bytes of payload to multicast group in net, and
+ * account for how it went.
+ */
+static int ping_multicast(struct net *net, struct sk_buff *skb,
+			  unsigned int group, size_t cnt)
+{
+	int    ret;
+	size_t len = skb->len;
+	u64    t   = lat_start();
+
+	/*
+	 * Send it over multicast to the group-th mc group in our array, only to
+	 * the listeners in net. -ESRCH just means that nobody was listening,
+	 * which is not worth more than a tracepoint.
+	 */
+	ret = genlmsg_multicast_netns(&genl_fam, net, skb, 0, group,
+				      GFP_KERNEL);
+	lat_stamp(LAT_PING_MCAST, t);
+	trace_genltest_mc_send(group, cnt, ret);
+	if (!ret) {
+		stats_inc(GENLTEST_STATS_A_MC_SENT);
+		stats_add(GENLTEST_STATS_A_TX_BYTES, len);
+	} else if (ret == -ESRCH) {
+		stats_inc(GENLTEST_STATS_A_MC_NOLISTEN);
+	} else {
+		/*
+		 * -ENOBUFS means that the socket of at least one of the
+		 * listeners overran, which they'll find out about by looking at
+		 * the sequence numbers, no need to flood the log with it.
+		 */
+		if (ret != -ENOBUFS) {
+			pr_err_ratelimited(
+				"failed to send multicast genl message\n");
+		}
+		stats_inc(GENLTEST_STATS_A_MC_FAILED);
+	}
+
+	return ret;
+}
+
+/*
+ * Whether anybody in net is listening to group, accounting for the n pings
+ * that won't be sent if not. Checking it first saves building a message only
+ * for genlmsg_multicast() to find out that nobody wants it. It's just a peek
+ * at the group's listeners, so somebody may still join or leave right after.
+ */
+static bool ping_has_listeners(struct net *net, unsigned int group,
+			       unsigned int n)
+{
+	if (likely(genl_has_listeners(&genl_fam, net, group))) {
+		return true;
+	}
+	stats_add(GENLTEST_STATS_A_MC_SKIPPED, n);
+
+	return false;
+}
+
+/* Multicast ping message to one of our genl multicast groups in net */
+static int echo_ping(struct net *net, unsigned int group, const char *buf,
+		     size_t cnt)
+{
+	struct genltest_net *gn = net_generic(net, genltest_net_id);
+	u32		     seq;
+	u64		     t;
+	struct sk_buff	    *skb;
+
+	/* Don't bother if nobody is going to get it */
+	if (!ping_has_listeners(net, group, 1)) {
+		return -ESRCH;
+	}
+
+	/*
+	 * Every message gets the next sequence number of its group, even the
+	 * ones that end up not being sent, listeners will see those as lost.
+	 */
+	seq = atomic_fetch_inc(&gn->ping_seq[group]);
+	t   = lat_start();
+	skb = ping_msg_new(group, seq, buf, cnt);
+
+	/* Without enough contiguous memory, try again with single pages */
+	if (PTR_ERR_OR_ZERO(skb) == -ENOMEM && cnt >= PAGE_SIZE) {
+		skb = ping_msg_new_paged(group, seq, buf, cnt);
+	}
+	if (IS_ERR(skb)) {
+		pr_err_ratelimited("failed to create genl message\n");
+		stats_err(PTR_ERR(skb));
+		return PTR_ERR(skb);
+	}
+	lat_stamp(LAT_PING_BUILD, t);
+
+	return ping_multicast(net, skb, group, cnt);
+}
+
+/*
+ * Asynchronous pings. Instead of building and multicasting a message right
+ * away, writers just add a copy of the payload to the lock-free queue of their
+ * CPU, and a work item sends everything that was queued within the next
+ * PING_COALESCE_US, packing as many pings as fit into each message. A burst of
+ * pings then costs a handful of skbs and multicasts instead of one each.
+ */
+
+/* How long the first ping in an empty queue waits for others to join it */
+#define PING_COALESCE_US 100
+/* Payload of each coalesced message, well below the 64 KiB limit of nests */
+#define PING_BATCH_LEN	 8192
+/* Pings that can be waiting in the queue of each CPU */
+#define PING_QUEUE_LEN	 4096
+
+struct ping_item {
+	struct llist_node node;
+	/* Where it goes, a reference to net is held until it's sent */
+	struct net	 *net;
+	unsigned int	  group;
+	size_t		  len;
+	/* The payload, NUL terminated */
+	char		  data[];
+};
+
+struct ping_queue {
+	struct llist_head   list;
+	atomic_t	    len;
+	struct delayed_work work;
+};
+
+static DEFINE_PER_CPU(struct ping_queue, ping_queues);
+
+/*
+ * Multicast the n pings to group in net starting at first, whose attributes
+ * add up to size bytes, in a single message. They get consecutive sequence
+ * numbers, and only the first one goes in the message. Pings queued on
+ * different CPUs are sent independently, so listeners may see their messages
+ * out of order.
+ */
+static void ping_send_batch(struct net *net, unsigned int group,
+			    struct llist_node *first, unsigned int n,
+			    size_t size)
+{
+	struct genltest_net *gn = net_generic(net, genltest_net_id);
+	unsigned int	  i;
+	void		 *hdr;
+	struct nlattr	 *nest;
+	struct ping_item *item;
+	u32		  seq;
+	u64		  t;
+	struct sk_buff	 *skb;
+
+	/* Listeners may have left while the pings were waiting */
+	if (!ping_has_listeners(net, group, n)) {
+		return;
+	}
+
+	seq = atomic_fetch_add(n, &gn->ping_seq[group]);
+	t   = lat_start();
+	skb = genlmsg_new(2 * nla_total_size(sizeof(u32)) +
+				  nla_total_size(size),
+			  GFP_KERNEL);
+	if (unlikely(!skb)) {
+		pr_err_ratelimited(
+			"failed to allocate memory for genl message\n");
+		stats_inc(GENLTEST_STATS_A_ENOMEM);
+		return;
+	}
+
+	hdr = genlmsg_put(skb, 0, 0, &genl_fam, 0, GENLTEST_CMD_ECHO);
+	if (unlikely(!hdr || nla_put_u32(skb, GENLTEST_A_MCGRP, group) ||
+		     nla_put_u32(skb, GENLTEST_A_SEQ, seq))) {
+		goto err;
+	}
+	nest = nla_nest_start(skb, GENLTEST_A_BATCH);
+	if (unlikely(!nest)) {
+		goto err;
+	}
+	for (i = 0; i < n; i++, first = first->next) {
+		item = llist_entry(first, struct ping_item, node);
+		if (unlikely(nla_put(skb, GENLTEST_A_MSG, item->len + 1,
+				     item->data))) {
+			goto err;
+		}
+	}
+	nla_nest_end(skb, nest);
+	genlmsg_end(skb, hdr);
+	lat_stamp(LAT_PING_BUILD, t);
+
+	if (!ping_multicast(net, skb, group, size) && n > 1) {
+		stats_add(GENLTEST_STATS_A_MC_COALESCED, n);
+	}
+	return;
+
+err:
+	pr_err_ratelimited("unable to create coalesced message\n");
+	stats_inc(GENLTEST_STATS_A_EMSGSIZE);
+	nlmsg_free(skb);
+}
+
+/* Send everything that is in the queue of a CPU */
+static void ping_queue_fn(struct work_struct *work)
+{
+	struct ping_queue *q	= container_of(to_delayed_work(work),
+					       struct ping_queue, work);
+	/* Take the whole queue at once, oldest first */
+	struct llist_node *node = llist_reverse_order(llist_del_all(&q->list));
+	struct llist_node *first, *next;
+	struct ping_item  *item;
+	struct net	  *net;
+	unsigned int	   n, group;
+	size_t		   size;
+
+	while (node) {
+		/*
+		 * As many pings to the same group in the same namespace as fit
+		 * in a message, at least one.
+		 */
+		first = node;
+		item  = llist_entry(first, struct ping_item, node);
+		net   = item->net;
+		group = item->group;
+		size  = 0;
+		for (n = 0; node; node = node->next, n++) {
+			size_t sz;
+
+			item = llist_entry(node, struct ping_item, node);
+			sz   = nla_total_size(item->len + 1);
+			if (n && (item->net != net || item->group != group ||
+				  size + sz > PING_BATCH_LEN)) {
+				break;
+			}
+			size += sz;
+		}
+
+		/* Big ones that don't fit in a batch go on their own */
+		if (size > PING_BATCH_LEN) {
+			item = llist_entry(first, struct ping_item, node);
+			echo_ping(net, group, item->data, item->len);
+		} else {
+			ping_send_batch(net, group, first, n, size);
+		}
+
+		atomic_sub(n, &q->len);
+		for (; n; n--, first = next) {
+			next = first->next;
+			item = llist_entry(first, struct ping_item, node);
+			put_net(item->net);
+			kfree(item);
+		}
+	}
+}
+
+/*
+ * Queue a ping of cnt bytes from buf to group in net to be sent asynchronously
+ */
+static int ping_enqueue(struct net *net, unsigned int group, const char *buf,
+			size_t cnt)
+{
+	struct ping_queue *q;
+	struct ping_item  *item;
+
+	/* Nothing to queue if nobody is going to get it */
+	if (!ping_has_listeners(net, group, 1)) {
+		return -ESRCH;
+	}
+
+	item = kmalloc(struct_size(item, data, cnt + 1), GFP_KERNEL);
+	if (unlikely(!item)) {
+		stats_inc(GENLTEST_STATS_A_ENOMEM);
+		return -ENOMEM;
+	}
+	item->net   = get_net(net);
+	item->group = group;
+	item->len   = cnt;
+	memcpy(item->data, buf, cnt);
+	item->data[cnt] = '\0';
+
+	/*
+	 * Stay on this CPU while touching its queue, so that there's never more
+	 * than one writer adding to it at a time besides the work draining it.
+	 */
+	q = get_cpu_ptr(&ping_queues);
+	if (unlikely(atomic_inc_return(&q->len) > PING_QUEUE_LEN)) {
+		atomic_dec(&q->len);
+		put_cpu_ptr(&ping_queues);
+		put_net(item->net);
+		kfree(item);
+		stats_inc(GENLTEST_STATS_A_MC_QFULL);
+		return -ENOBUFS;
+	}
+	/* The first one into an empty queue schedules the work to send it */
+	if (llist_add(&item->node, &q->list)) {
+		queue_delayed_work_on(smp_processor_id(), system_wq, &q->work,
+				      usecs_to_jiffies(PING_COALESCE_US));
+	}
+	put_cpu_ptr(&ping_queues);
+
+	return 0;
+}
+
+static void ping_queue_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct ping_queue *q = per_cpu_ptr(&ping_queues, cpu);
+
+		init_llist_head(&q->list);
+		atomic_set(&q->len, 0);
+		INIT_DELAYED_WORK(&q->work, ping_queue_fn);
+	}
+}
+
+/* Send whatever is still queued, once nobody can queue more */
+static void ping_queue_flush(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		flush_delayed_work(&per_cpu_ptr(&ping_queues, cpu)->work);
+	}
+}
+
+/*
+ * Shared rings, see struct genltest_ring. The kernel keeps its own copy of
+ * the head of each ring, what's in the shared page is only ever written by
+ * us and never trusted, and the tail written by the consumer is only used to
+ * tell how much room there is. A bogus tail can only get pings dropped, or
+ * records that the consumer didn't read yet overwritten.
+ */
+static unsigned int ring_pages;
+module_param(ring_pages, uint, 0444);
+MODULE_PARM_DESC(ring_pages,
+		 "Size of each per-CPU shared ring in pages, a power of two, "
+		 "0 for no rings");
+
+/* Well within what the 32-bit head and tail of the rings can tell apart */
+#define RING_MAX_PAGES (SZ_1G / PAGE_SIZE)
+
+struct ping_ring {
+	/* Where the next record goes */
+	u32		   head;
+	atomic64_t	   dropped;
+	unsigned int	   cpu;
+	/* Multicasts the overflow notification outside of the hot path */
+	struct work_struct overflow;
+};
+
+static DEFINE_PER_CPU(struct ping_ring, ping_rings);
+
+/* vmalloc_user() area of all of the rings, NULL if there are none */
+static void  *ring_area;
+static u32    ring_size;
+static size_t ring_stride;
+
+/* Consumers sleeping in poll() */
+static DECLARE_WAIT_QUEUE_HEAD(ring_wait);
+
+/*
+ * Protects ring_net, the namespace whose pings go into the rings, of
+ * whoever last asked for them with GENLTEST_CMD_RING. No reference to it is
+ * held, which would keep it around for as long as the rings are its, instead
+ * it's cleared when the namespace goes away. Producers only compare it with
+ * the namespace they ping in, so they don't need the lock.
+ */
+static DEFINE_MUTEX(ring_lock);
+static struct net   *ring_net;
+static unsigned int  ring_groups;
+
+static void ring_net_exit(struct net *net)
+{
+	mutex_lock(&ring_lock);
+	if (ring_net == net) {
+		WRITE_ONCE(ring_net, NULL);
+	}
+	mutex_unlock(&ring_lock);
+}
+
+static inline struct genltest_ring *ring_hdr(unsigned int cpu)
+{
+	return ring_area + cpu * ring_stride;
+}
+
+static inline char *ring_data(unsigned int cpu)
+{
+	return ring_area + cpu * ring_stride + PAGE_SIZE;
+}
+
+/* Tell the listeners of the urgent group that a ring dropped pings */
+static void ring_overflow_fn(struct work_struct *work)
+{
+	struct ping_ring *r = container_of(work, struct ping_ring, overflow);
+	struct net	 *net;
+	struct sk_buff	 *skb;
+	void		 *hdr;
+
+	/* Unless the namespace is on its way out already */
+	mutex_lock(&ring_lock);
+	net = ring_net ? maybe_get_net(ring_net) : NULL;
+	mutex_unlock(&ring_lock);
+	if (!net) {
+		return;
+	}
+	if (!genl_has_listeners(&genl_fam, net, GENLTEST_MCGRP_URGENT)) {
+		goto out;
+	}
+
+	skb = genlmsg_new(nla_total_size(sizeof(u32)) +
+				  nla_total_size_64bit(sizeof(u64)),
+			  GFP_KERNEL);
+	if (unlikely(!skb)) {
+		stats_inc(GENLTEST_STATS_A_ENOMEM);
+		goto out;
+	}
+	hdr = genlmsg_put(skb, 0, 0, &genl_fam, 0, GENLTEST_CMD_RING);
+	if (unlikely(!hdr || nla_put_u32(skb, GENLTEST_A_RING_INDEX, r->cpu) ||
+		     nla_put_u64_64bit(skb, GENLTEST_A_RING_DROPPED,
+				       atomic64_read(&r->dropped),
+				       GENLTEST_A_PAD))) {
+		stats_inc(GENLTEST_STATS_A_EMSGSIZE);
+		nlmsg_free(skb);
+		goto out;
+	}
+	genlmsg_end(skb, hdr);
+	genlmsg_multicast_netns(&genl_fam, net, skb, 0, GENLTEST_MCGRP_URGENT,
+				GFP_KERNEL);
+
+out:
+	put_net(net);
+}
 
 /*
- * Some materials that were used as source for this example/tutorial/guide:
- *
- * - https://wiki.linuxfoundation.org/networking/generic_netlink_howto
- * - https://kernel.org/doc/html/next/userspace-api/netlink/intro.html
+ * Write a ping of cnt bytes from buf to group into the ring of the current
+ * CPU. Preemption is disabled all along, so that nothing else on this CPU
+ * writes to the same ring at the same time. Returns whether it fit.
  */
+static bool ring_write(unsigned int group, const char *buf, size_t cnt)
+{
+	u32			  len, off, pad, used;
+	struct ping_ring	 *r    = get_cpu_ptr(&ping_rings);
+	struct genltest_ring	 *hdr  = ring_hdr(r->cpu);
+	char			 *data = ring_data(r->cpu);
+	struct genltest_ring_rec *rec;
 
-#define MSG_MAX_LEN 1024
+	/* Records before the tail have been read, and are free to reuse */
+	len  = ALIGN(sizeof(*rec) + cnt, GENLTEST_RING_REC_ALIGN);
+	used = r->head - smp_load_acquire(&hdr->tail);
+	off  = r->head & (ring_size - 1);
+	pad  = off + len > ring_size ? ring_size - off : 0;
+	if (unlikely(used > ring_size || used + pad + len > ring_size)) {
+		WRITE_ONCE(hdr->dropped, atomic64_inc_return(&r->dropped));
+		/* Only once until the work gets to run, not once per drop */
+		schedule_work(&r->overflow);
+		put_cpu_ptr(&ping_rings);
+		stats_inc(GENLTEST_STATS_A_RING_DROPPED);
+		return false;
+	}
 
-/* Forward declaration */
-static struct genl_family genl_fam;
+	/* Skip what's left until the end, the record goes at the start */
+	if (pad) {
+		rec	   = (struct genltest_ring_rec *)(data + off);
+		rec->len   = pad;
+		rec->group = GENLTEST_RING_PAD;
+		r->head += pad;
+		off = 0;
+	}
+	rec	      = (struct genltest_ring_rec *)(data + off);
+	rec->len      = len;
+	rec->group    = group;
+	rec->data_len = cnt;
+	memcpy(rec->data, buf, cnt);
+	r->head += len;
 
-/* Handler for GENLTEST_CMD_ECHO messages received */
-static int echo_doit(struct sk_buff *skb, struct genl_info *info)
+	/* The records have to be visible before the head that covers them */
+	smp_store_release(&hdr->head, r->head);
+
+	/*
+	 * And the head before looking at whether the consumer sleeps, which it
+	 * only does after saying so and looking at the head once more.
+	 */
+	smp_mb();
+	if (READ_ONCE(hdr->waiting)) {
+		WRITE_ONCE(hdr->waiting, 0);
+		put_cpu_ptr(&ping_rings);
+		wake_up_interruptible(&ring_wait);
+	} else {
+		put_cpu_ptr(&ping_rings);
+	}
+	stats_inc(GENLTEST_STATS_A_RING_SENT);
+
+	return true;
+}
+
+/* Put a ping into the rings, if they want pings to group from net */
+static bool ring_ping(struct net *net, unsigned int group, const char *buf,
+		      size_t cnt)
 {
-	int		ret = 0;
+	if (likely(!ring_area) || READ_ONCE(ring_net) != net ||
+	    !(READ_ONCE(ring_groups) & BIT(group))) {
+		return false;
+	}
+
+	return ring_write(group, buf, cnt);
+}
+
+static int __init ring_init(void)
+{
+	int cpu;
+
+	BUILD_BUG_ON(sizeof(struct genltest_ring) > PAGE_SIZE);
+
+	if (!ring_pages) {
+		return 0;
+	}
+	if (!is_power_of_2(ring_pages) || ring_pages > RING_MAX_PAGES) {
+		pr_err("ring_pages must be a power of two, at most %lu\n",
+		       RING_MAX_PAGES);
+		return -EINVAL;
+	}
+
+	/* All of them in one area, to be mapped in one go */
+	ring_size   = ring_pages << PAGE_SHIFT;
+	ring_stride = PAGE_SIZE + ring_size;
+	ring_area   = vmalloc_user(array_size(nr_cpu_ids, ring_stride));
+	if (!ring_area) {
+		return -ENOMEM;
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct ping_ring *r = per_cpu_ptr(&ping_rings, cpu);
+
+		r->head = 0;
+		r->cpu	= cpu;
+		atomic64_set(&r->dropped, 0);
+		INIT_WORK(&r->overflow, ring_overflow_fn);
+	}
+
+	return 0;
+}
+
+/* Once nothing can ping anymore, before the family goes away */
+static void ring_flush(void)
+{
+	int cpu;
+
+	if (!ring_area) {
+		return;
+	}
+	for_each_possible_cpu(cpu) {
+		cancel_work_sync(&per_cpu_ptr(&ping_rings, cpu)->overflow);
+	}
+}
+
+/* Once nobody can ask for the rings anymore either */
+static void ring_exit(void)
+{
+	vfree(ring_area);
+}
+
+/*
+ * Handler for GENLTEST_CMD_RING messages received. If the sender says which
+ * groups it wants, pings to them in its namespace go into the rings from now
+ * on. Either way, it gets to know how the rings are laid out.
+ */
+static int ring_doit(struct sk_buff *skb, struct genl_info *info)
+{
+	struct nlattr  *groups	= info->attrs[GENLTEST_A_RING_GROUPS];
+	u64		dropped = 0;
+	unsigned int	cur;
+	int		cpu;
 	void	       *hdr;
 	struct sk_buff *msg;
 
-	/* Check if the attribute is present and print it */
-	if (info->attrs[GENLTEST_A_MSG]) {
-		char *str = nla_data(info->attrs[GENLTEST_A_MSG]);
-		pr_info("message received: %s\n", str);
-	} else {
-		pr_info("empty message received\n");
+	if (!ring_area) {
+		NL_SET_ERR_MSG(info->extack,
+			       "no rings, the module was loaded without them");
+		return -EOPNOTSUPP;
+	}
+
+	mutex_lock(&ring_lock);
+	if (groups) {
+		WRITE_ONCE(ring_net, genl_info_net(info));
+		WRITE_ONCE(ring_groups, nla_get_u32(groups));
+	}
+	cur = ring_groups;
+	mutex_unlock(&ring_lock);
+
+	for_each_possible_cpu(cpu) {
+		struct ping_ring *r = per_cpu_ptr(&ping_rings, cpu);
+
+		dropped += atomic64_read(&r->dropped);
 	}
 
-	/* Allocate a new buffer for the reply */
-	msg = nlmsg_new(NLMSG_DEFAULT_SIZE, GFP_KERNEL);
+	msg = genlmsg_new(3 * nla_total_size(sizeof(u32)) +
+				  nla_total_size_64bit(sizeof(u64)),
+			  GFP_KERNEL);
 	if (!msg) {
-		pr_err("failed to allocate message buffer\n");
+		NL_SET_ERR_MSG(info->extack, "failed to allocate ring reply");
+		stats_inc(GENLTEST_STATS_A_ENOMEM);
 		return -ENOMEM;
 	}
 
-	/* Put the Generic Netlink header */
 	hdr = genlmsg_put(msg, info->snd_portid, info->snd_seq, &genl_fam, 0,
-			  GENLTEST_CMD_ECHO);
-	if (!hdr) {
-		pr_err("failed to create genetlink header\n");
+			  GENLTEST_CMD_RING);
+	if (!hdr || nla_put_u32(msg, GENLTEST_A_RING_GROUPS, cur) ||
+	    nla_put_u32(msg, GENLTEST_A_RING_SIZE, ring_size) ||
+	    nla_put_u32(msg, GENLTEST_A_RING_COUNT, nr_cpu_ids) ||
+	    nla_put_u64_64bit(msg, GENLTEST_A_RING_DROPPED, dropped,
+			      GENLTEST_A_PAD)) {
+		NL_SET_ERR_MSG(info->extack, "failed to create ring reply");
+		stats_inc(GENLTEST_STATS_A_EMSGSIZE);
 		nlmsg_free(msg);
 		return -EMSGSIZE;
 	}
-	/* And the message */
-	if ((ret = nla_put_string(msg, GENLTEST_A_MSG,
-				  "Hello from Kernel Space, Netlink!"))) {
-		pr_err("failed to create message string\n");
-		genlmsg_cancel(msg, hdr);
-		nlmsg_free(msg);
-		goto out;
+	genlmsg_end(msg, hdr);
+
+	return genlmsg_reply(msg, info);
+}
+
+/*
+ * Rate limiting of pings, per group and namespace, so that producers that go
+ * faster than the listeners can take are held back instead of flooding them
+ * until they overrun. It's a token bucket in the form of the generic cell rate
+ * algorithm: all of its state is tat, the time at which the bucket will be
+ * full again, and a ping can go as long as that time is no further away than
+ * ping_rate_burst - 1 pings.
+ */
+static unsigned int ping_rate[__GENLTEST_MCGRP_MAX];
+module_param_array(ping_rate, uint, NULL, 0644);
+MODULE_PARM_DESC(ping_rate,
+		 "Pings per second allowed to each multicast group, 0 for no "
+		 "limit");
+
+static unsigned int ping_rate_burst = 32;
+module_param(ping_rate_burst, uint, 0644);
+MODULE_PARM_DESC(ping_rate_burst,
+		 "Pings that can go back to back to a rate limited group");
+
+static bool ping_block;
+module_param(ping_block, bool, 0644);
+MODULE_PARM_DESC(ping_block,
+		 "Make pingers over the rate wait instead of failing with "
+		 "EAGAIN");
+
+/*
+ * Take a token for a ping to group. Returns 0 if there was one, otherwise how
+ * many nanoseconds until there will be.
+ */
+static u64 ping_admit(struct genltest_net *gn, unsigned int group)
+{
+	unsigned int rate  = READ_ONCE(ping_rate[group]);
+	unsigned int burst = max(READ_ONCE(ping_rate_burst), 1U);
+	u64	     cost, tau, now, tat;
+	s64	     old;
+
+	if (likely(!rate)) {
+		return 0;
 	}
 
-	/* Finalize the message and send it */
-	genlmsg_end(msg, hdr);
+	cost = div_u64(NSEC_PER_SEC, rate);
+	tau  = cost * (burst - 1);
+	now  = ktime_get_ns();
+	old  = atomic64_read(&gn->ping_tat[group]);
+	do {
+		/* An idle bucket is just full, not any fuller */
+		tat = max_t(u64, old, now);
+		if (tat - now > tau) {
+			return tat - now - tau;
+		}
+	} while (!atomic64_try_cmpxchg(&gn->ping_tat[group], &old, tat + cost));
 
-	ret = genlmsg_reply(msg, info);
-	pr_info("reply sent\n");
+	return 0;
+}
 
-out:
-	return ret;
+/*
+ * Let a ping to group in net through the rate limiter. Over the rate, it fails
+ * with -EAGAIN, unless ping_block is set and the pinger can wait, in which case
+ * it sleeps until there's a token for it. Sleeping is interrupted by signals,
+ * and by kthread_stop() for kthreads.
+ */
+static int ping_throttle(struct net *net, unsigned int group, bool nowait)
+{
+	struct genltest_net *gn	    = net_generic(net, genltest_net_id);
+	bool		     waited = false;
+	ktime_t		     timeout;
+	u64		     wait;
+
+	while ((wait = ping_admit(gn, group))) {
+		if (nowait || !READ_ONCE(ping_block)) {
+			stats_inc(GENLTEST_STATS_A_MC_THROTTLED);
+			return -EAGAIN;
+		}
+		if (signal_pending(current) ||
+		    ((current->flags & PF_KTHREAD) && kthread_should_stop())) {
+			return -EINTR;
+		}
+		if (!waited) {
+			stats_inc(GENLTEST_STATS_A_MC_WAITED);
+			waited = true;
+		}
+		timeout = ns_to_ktime(wait);
+		set_current_state(TASK_INTERRUPTIBLE);
+		schedule_hrtimeout_range(&timeout, 10 * NSEC_PER_USEC,
+					 HRTIMER_MODE_REL);
+	}
+
+	return 0;
 }
 
-/* Attribute validation policy for our echo command */
-static struct nla_policy echo_pol[GENLTEST_A_MAX + 1] = {
-	[GENLTEST_A_MSG] = { .type = NLA_NUL_STRING },
-};
+/*
+ * NUMA-local pings. genlmsg_multicast() clones and delivers on the CPU of the
+ * producer, and then wakes up the listeners wherever they last ran, so with
+ * listeners all over the machine most of the pings cross nodes. With ping_numa
+ * set, pings to the default group go to the group of the node of the CPU that
+ * produces them instead, which listeners pinned to that node join, and are
+ * consumed on the same node as they are built. Pings from a node that nobody
+ * listens to go to the default group as usual.
+ */
+static bool ping_numa;
+module_param(ping_numa, bool, 0644);
+MODULE_PARM_DESC(ping_numa,
+		 "Multicast pings to the default group by node of origin");
 
-/* Operations for our Generic Netlink family */
-static struct genl_ops genl_ops[] = {
-	{
-		.cmd	= GENLTEST_CMD_ECHO,
-		.policy = echo_pol,
-		.doit	= echo_doit,
-	 },
-};
+/* Group that a ping to group in net is multicast to */
+static unsigned int ping_node_group(struct net *net, unsigned int group)
+{
+	unsigned int node;
 
-/* Multicast groups for our family */
-static const struct genl_multicast_group genl_mcgrps[] = {
-	{ .name = GENLTEST_MC_GRP_NAME },
-};
+	if (!READ_ONCE(ping_numa) || group != GENLTEST_MCGRP_DEFAULT) {
+		return group;
+	}
+	/* Even if we're moved to another node right after, it's a hint */
+	node = GENLTEST_MCGRP_NODE0 + numa_node_id() % GENLTEST_MCGRP_NODES;
 
-/* Generic Netlink family */
-static struct genl_family genl_fam = {
-	.name	  = GENLTEST_GENL_NAME,
-	.version  = GENLTEST_GENL_VERSION,
-	.maxattr  = GENLTEST_A_MAX,
-	.ops	  = genl_ops,
-	.n_ops	  = ARRAY_SIZE(genl_ops),
-	.mcgrps	  = genl_mcgrps,
-	.n_mcgrps = ARRAY_SIZE(genl_mcgrps),
-};
+	return genl_has_listeners(&genl_fam, net, node) ? node : group;
+}
 
-/* Multicast ping message to our genl multicast group */
-static int echo_ping(const char *buf, size_t cnt)
+/*
+ * Ping group in net now or later, depending on async_ping, as long as the rate
+ * of the group allows it. nowait is for pingers that can't be made to wait for
+ * it, whatever ping_block says. Rates and rings go by the group asked for,
+ * only multicast goes by node.
+ */
+static int ping(struct net *net, unsigned int group, const char *buf,
+		size_t cnt, bool nowait)
 {
-	int		ret = 0;
-	void	       *hdr;
-	/* Allocate message buffer */
-	struct sk_buff *skb = genlmsg_new(NLMSG_DEFAULT_SIZE, GFP_KERNEL);
+	bool ringed;
+	int  ret = ping_throttle(net, group, nowait);
 
-	if (unlikely(!skb)) {
-		pr_err("failed to allocate memory for genl message\n");
-		return -ENOMEM;
+	if (ret) {
+		return ret;
 	}
 
-	/* Put the Generic Netlink header */
-	hdr = genlmsg_put(skb, 0, 0, &genl_fam, 0, GENLTEST_CMD_ECHO);
-	if (unlikely(!hdr)) {
-		pr_err("failed to allocate memory for genl header\n");
-		nlmsg_free(skb);
-		return -ENOMEM;
+	ringed = ring_ping(net, group, buf, cnt);
+	group  = ping_node_group(net, group);
+	ret    = READ_ONCE(async_ping) ? ping_enqueue(net, group, buf, cnt) :
+					 echo_ping(net, group, buf, cnt);
+
+	/* The ring is somebody listening too */
+	return ringed && ret == -ESRCH ? 0 : ret;
+}
+
+/*
+ * Test sysfs attr to send multicast messages. The string in the buffer will be 
+ * echoed to the multicast group, unless it's longer than msg_max_len.
+ */
+static ssize_t ping_store(struct kobject *kobj, struct kobj_attribute *attr,
+			  const char *buf, size_t cnt)
+{
+	int ret;
+
+	if (cnt > READ_ONCE(msg_max_len)) {
+		return -EMSGSIZE;
 	}
 
-	/* And the message */
-	if ((ret = nla_put_string(skb, GENLTEST_A_MSG, buf))) {
-		pr_err("unable to create message string\n");
-		genlmsg_cancel(skb, hdr);
-		nlmsg_free(skb);
+	/*
+	 * Whatever kept the ping from going out is the writer's business, like
+	 * with the device, except that nobody was listening.
+	 */
+	ret = ping(ping_net(), READ_ONCE(ping_group), buf, cnt, false);
+	if (ret < 0 && ret != -ESRCH) {
 		return ret;
 	}
 
-	/* Finalize the message */
-	genlmsg_end(skb, hdr);
+	return cnt;
+}
+
+/* sysfs attr to choose the multicast group that the ping attr sends to */
+static ssize_t ping_group_store(struct kobject *kobj,
+				struct kobj_attribute *attr, const char *buf,
+				size_t cnt)
+{
+	unsigned int group;
+	int	     ret = kstrtouint(buf, 0, &group);
+
+	if (ret) {
+		return ret;
+	}
+	if (group > GENLTEST_MCGRP_MAX) {
+		return -EINVAL;
+	}
+	WRITE_ONCE(ping_group, group);
 
-	/* Send it over multicast to the 0-th mc group in our array. */
-	ret = genlmsg_multicast(&genl_fam, skb, 0, 0, GFP_KERNEL);
-	if (ret == -ESRCH) {
-		pr_warn("multicast message sent, but nobody was listening...\n");
-	} else if (ret) {
-		pr_err("failed to send multicast genl message\n");
+	return cnt;
+}
+
+static ssize_t ping_group_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	unsigned int group = READ_ONCE(ping_group);
+
+	return sysfs_emit(buf, "%u %s\n", group, genltest_nl_mcgrps[group].name);
+}
+
+/*
+ * A burst of multicast pings sent from a kthread, to load test the multicast
+ * group from the kernel itself instead of through one sysfs write per ping.
+ */
+struct ping_burst {
+	/*
+	 * What to send: count pings of size bytes to group, at most rate per
+	 * second
+	 */
+	unsigned int count;
+	size_t	     size;
+	unsigned int rate;
+	unsigned int group;
+	/*
+	 * In the namespace of whoever started it, a reference is held for as
+	 * long as it runs
+	 */
+	struct net  *net;
+	/* And how it went */
+	bool	     running;
+	unsigned int sent;
+	unsigned int nolisten;
+	unsigned int failed;
+	u64	     elapsed_ns;
+};
+
+/*
+ * Protects burst and burst_task. The kthread goes away by itself once done,
+ * a reference to its task_struct is held so that it can still be stopped.
+ */
+static DEFINE_MUTEX(burst_lock);
+static struct ping_burst   burst;
+static struct task_struct *burst_task;
+
+static int ping_burst_fn(void *data)
+{
+	int		  ret;
+	unsigned int	  i, sent = 0, nolisten = 0, failed = 0;
+	u64		  start, now, next;
+	struct ping_burst b;
+	char		 *buf;
+
+	mutex_lock(&burst_lock);
+	b = *(struct ping_burst *)data;
+	mutex_unlock(&burst_lock);
+
+	buf = kvmalloc(b.size, GFP_KERNEL);
+	if (buf) {
+		memset(buf, 'x', b.size);
 	} else {
-		pr_info("multicast message sent\n");
+		failed = b.count;
+		b.count = 0;
 	}
 
-	return ret;
+	start = ktime_get_ns();
+	for (i = 0; i < b.count && !kthread_should_stop(); i++) {
+		ret = ping(b.net, b.group, buf, b.size, false);
+		if (!ret) {
+			sent++;
+		} else if (ret == -ESRCH) {
+			nolisten++;
+		} else {
+			failed++;
+		}
+
+		/* Sleep until the next one is due if there's a rate limit */
+		if (!b.rate) {
+			cond_resched();
+			continue;
+		}
+		now  = ktime_get_ns();
+		next = start + div_u64((u64)(i + 1) * NSEC_PER_SEC, b.rate);
+		if (next > now + 10 * NSEC_PER_USEC) {
+			u64 us = div_u64(next - now, NSEC_PER_USEC);
+			usleep_range(us, us + 10);
+		} else {
+			cond_resched();
+		}
+	}
+	now = ktime_get_ns();
+	kvfree(buf);
+
+	/* Done with the namespace, which can go away from now on */
+	mutex_lock(&burst_lock);
+	burst.sent	 = sent;
+	burst.nolisten	 = nolisten;
+	burst.failed	 = failed;
+	burst.elapsed_ns = now - start;
+	burst.running	 = false;
+	put_net(burst.net);
+	burst.net = NULL;
+	mutex_unlock(&burst_lock);
+
+	return 0;
 }
 
 /*
- * Test sysfs attr to send multicast messages. The string in the buffer will be 
- * echoed to the multicast group.
+ * Reap the kthread of a burst, taken out of burst_task, stopping it first if
+ * it's still at it. A kthread stopped before it even got to run never puts the
+ * namespace, which is then up to us, unless a new burst started meanwhile.
+ * burst_lock not held.
  */
-static ssize_t ping_store(struct kobject *kobj, struct kobj_attribute *attr,
-			  const char *buf, size_t cnt)
+static void ping_burst_reap(struct task_struct *task)
+{
+	kthread_stop(task);
+	put_task_struct(task);
+
+	mutex_lock(&burst_lock);
+	if (burst.running && !burst_task) {
+		put_net(burst.net);
+		burst.net     = NULL;
+		burst.running = false;
+	}
+	mutex_unlock(&burst_lock);
+}
+
+/* Stop the burst kthread, whether it finished or not. burst_lock not held. */
+static void ping_burst_stop(void)
+{
+	struct task_struct *task;
+
+	mutex_lock(&burst_lock);
+	task	   = burst_task;
+	burst_task = NULL;
+	mutex_unlock(&burst_lock);
+
+	if (task) {
+		ping_burst_reap(task);
+	}
+}
+
+/*
+ * sysfs attr to start a burst of multicast pings. It takes "count [size [rate
+ * [group]]]", where rate is in pings per second and 0 means as fast as
+ * possible, and group defaults to the one of the ping attr. Writing 0 stops
+ * the burst that is running, if any.
+ */
+static ssize_t ping_burst_store(struct kobject *kobj,
+				struct kobj_attribute *attr, const char *buf,
+				size_t cnt)
+{
+	unsigned int	    count, rate = 0, group = READ_ONCE(ping_group);
+	size_t		    size = DUMP_MSG_LEN;
+	struct task_struct *task;
+
+	if (sscanf(buf, "%u %zu %u %u", &count, &size, &rate, &group) < 1) {
+		return -EINVAL;
+	}
+	if (!count) {
+		ping_burst_stop();
+		return cnt;
+	}
+	if (!size || group > GENLTEST_MCGRP_MAX) {
+		return -EINVAL;
+	}
+	if (size > READ_ONCE(msg_max_len)) {
+		return -EMSGSIZE;
+	}
+
+	mutex_lock(&burst_lock);
+	if (burst.running) {
+		mutex_unlock(&burst_lock);
+		return -EBUSY;
+	}
+	/* The last burst is over, but its task_struct is still ours */
+	task	   = burst_task;
+	burst_task = NULL;
+	if (task) {
+		mutex_unlock(&burst_lock);
+		ping_burst_reap(task);
+		mutex_lock(&burst_lock);
+		if (burst_task || burst.running) {
+			mutex_unlock(&burst_lock);
+			return -EBUSY;
+		}
+	}
+
+	burst = (struct ping_burst){
+		.count	 = count,
+		.size	 = size,
+		.rate	 = rate,
+		.group	 = group,
+		.net	 = get_net(ping_net()),
+		.running = true,
+	};
+	task = kthread_create(ping_burst_fn, &burst, "genltest_burst");
+	if (IS_ERR(task)) {
+		put_net(burst.net);
+		burst.net     = NULL;
+		burst.running = false;
+		mutex_unlock(&burst_lock);
+		return PTR_ERR(task);
+	}
+	/* Before it can exit, and take its task_struct with it */
+	get_task_struct(task);
+	burst_task = task;
+	wake_up_process(task);
+	mutex_unlock(&burst_lock);
+
+	return cnt;
+}
+
+/* sysfs attr with the results of the last burst of multicast pings */
+static ssize_t ping_burst_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	int		  len = 0;
+	u64		  rate = 0;
+	struct ping_burst b;
+
+	mutex_lock(&burst_lock);
+	b = burst;
+	mutex_unlock(&burst_lock);
+
+	if (b.elapsed_ns) {
+		rate = div64_u64((u64)(b.sent + b.nolisten + b.failed) *
+					 NSEC_PER_SEC,
+				 b.elapsed_ns);
+	}
+
+	len += sysfs_emit_at(buf, len, "running %d\n", b.running);
+	len += sysfs_emit_at(buf, len, "count %u\n", b.count);
+	len += sysfs_emit_at(buf, len, "size %zu\n", b.size);
+	len += sysfs_emit_at(buf, len, "group %u\n", b.group);
+	len += sysfs_emit_at(buf, len, "sent %u\n", b.sent);
+	len += sysfs_emit_at(buf, len, "nolisten %u\n", b.nolisten);
+	len += sysfs_emit_at(buf, len, "failed %u\n", b.failed);
+	len += sysfs_emit_at(buf, len, "elapsed_ns %llu\n", b.elapsed_ns);
+	len += sysfs_emit_at(buf, len, "rate %llu\n", rate);
+
+	return len;
+}
+
+/*
+ * sysfs attr with the statistics of the module, one "name value" pair per
+ * line. The same counters can be read with GENLTEST_CMD_GET_STATS.
+ */
+static ssize_t stats_show(struct kobject *kobj, struct kobj_attribute *attr,
+			  char *buf)
 {
-	int max = cnt > MSG_MAX_LEN ? MSG_MAX_LEN : cnt;
-	echo_ping(buf, max);
+	int i, len = 0;
+	u64 sum[__GENLTEST_STATS_A_MAX];
+
+	stats_read(sum);
+	for (i = GENLTEST_STATS_A_PAD + 1; i <= GENLTEST_STATS_A_MAX; i++) {
+		len += sysfs_emit_at(buf, len, "%s %llu\n",
+				     genltest_stats_names[i], sum[i]);
+	}
 
-	return max;
+	return len;
+}
+
+/*
+ * Random, picked anew each time that the module is loaded, and so each time
+ * that the family is registered. Userspace keys what it caches of the family
+ * on it: the ids alone can't tell a reload apart, the family and its groups
+ * may well get the same ones back, or ones that some other family had.
+ */
+static u64 instance;
+
+/* sysfs attr with the instance of the module */
+static ssize_t instance_show(struct kobject *kobj, struct kobj_attribute *attr,
+			     char *buf)
+{
+	return sysfs_emit(buf, "%llu\n", instance);
 }
 
 static struct kobject	    *kobj;
-static struct kobj_attribute ping_attr = __ATTR_WO(ping);
+static struct kobj_attribute instance_attr   = __ATTR_RO(instance);
+static struct kobj_attribute ping_attr	     = __ATTR_WO(ping);
+static struct kobj_attribute ping_group_attr = __ATTR_RW(ping_group);
+static struct kobj_attribute ping_burst_attr = __ATTR_RW(ping_burst);
+static struct kobj_attribute stats_attr	     = __ATTR_RO(stats);
+
+static struct attribute *genltest_attrs[] = {
+	&instance_attr.attr,
+	&ping_attr.attr,
+	&ping_group_attr.attr,
+	&ping_burst_attr.attr,
+	&stats_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group genltest_attr_group = {
+	.attrs = genltest_attrs,
+};
+
+/*
+ * /dev/genltest, the fast way to ping. Every segment of a write(), writev() or
+ * io_uring write becomes one ping to the group of the ping attr, so that
+ * producers can send thousands of them per syscall instead of one per write to
+ * sysfs. Empty segments are skipped, and segments longer than msg_max_len are
+ * rejected with -EMSGSIZE. It's also the way to the shared rings, with mmap()
+ * and poll().
+ */
+static ssize_t genltest_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	ssize_t	     done = 0;
+	int	     ret  = 0;
+	size_t	     max  = READ_ONCE(msg_max_len);
+	unsigned int group = READ_ONCE(ping_group);
+	struct net  *net   = ping_net();
+	bool	     nowait = (iocb->ki_filp->f_flags & O_NONBLOCK) ||
+			      (iocb->ki_flags & IOCB_NOWAIT);
+	char	    *buf;
+
+	buf = kvmalloc(max, GFP_KERNEL);
+	if (!buf) {
+		return -ENOMEM;
+	}
+
+	while (iov_iter_count(from)) {
+		size_t len = iov_iter_single_seg_count(from);
+
+		/* Advancing by nothing moves on to the next segment */
+		if (!len) {
+			iov_iter_advance(from, 0);
+			continue;
+		}
+		if (len > max) {
+			ret = -EMSGSIZE;
+			break;
+		}
+		if (copy_from_iter(buf, len, from) != len) {
+			ret = -EFAULT;
+			break;
+		}
+		/*
+		 * Over the rate of the group, this ping and the ones after it
+		 * are for the writer to try again.
+		 */
+		ret = ping(net, group, buf, len, nowait);
+		if (ret == -EAGAIN || ret == -EINTR) {
+			break;
+		}
+		done += len;
+
+		/* Nobody listening is not the writer's fault */
+		if (ret && ret != -ESRCH) {
+			break;
+		}
+		ret = 0;
+
+		if (fatal_signal_pending(current)) {
+			break;
+		}
+		cond_resched();
+	}
+	kvfree(buf);
+
+	/* Report what was pinged, or the error if it failed right away */
+	return done ? done : ret;
+}
+
+/*
+ * Map the shared rings, all of them or from some page on. The area comes from
+ * vmalloc_user(), which is what makes it mappable.
+ */
+static int genltest_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	if (!ring_area) {
+		return -ENODEV;
+	}
+
+	return remap_vmalloc_range(vma, ring_area, vma->vm_pgoff);
+}
+
+/*
+ * Readable once any of the rings has records left to read. Producers only wake
+ * us up if the consumer set the waiting flag of their ring before sleeping.
+ */
+static __poll_t genltest_poll(struct file *file, poll_table *wait)
+{
+	int cpu;
+
+	if (!ring_area) {
+		return EPOLLERR;
+	}
+
+	poll_wait(file, &ring_wait, wait);
+	for_each_possible_cpu(cpu) {
+		if (READ_ONCE(ring_hdr(cpu)->tail) !=
+		    READ_ONCE(per_cpu_ptr(&ping_rings, cpu)->head)) {
+			return EPOLLIN | EPOLLRDNORM;
+		}
+	}
+
+	return 0;
+}
+
+static const struct file_operations genltest_fops = {
+	.owner	    = THIS_MODULE,
+	.open	    = nonseekable_open,
+	.write_iter = genltest_write_iter,
+	.mmap	    = genltest_mmap,
+	.poll	    = genltest_poll,
+};
+
+static struct miscdevice genltest_misc = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name  = GENLTEST_DEV_NAME,
+	.fops  = &genltest_fops,
+	.mode  = 0600,
+};
 
 static int __init init_genltest(void)
 {
@@ -172,38 +2176,96 @@ static int __init init_genltest(void)
 
 	pr_info("init start\n");
 
+	/* Never 0, which is what userspace takes for no instance at all */
+	instance = get_random_u64() ?: 1;
+	stats_init();
+	lat_init();
+	ping_queue_init();
+
+	ret = ring_init();
+	if (unlikely(ret)) {
+		pr_err("unable to create shared rings\n");
+		return ret;
+	}
+
+	ret = echo_reply_tmpl_init();
+	if (unlikely(ret)) {
+		pr_err("unable to create echo reply\n");
+		goto err_ring;
+	}
+
+	/* Before anything that can ping, which needs the state of its netns */
+	ret = register_pernet_subsys(&genltest_net_ops);
+	if (unlikely(ret)) {
+		pr_err("unable to register pernet operations\n");
+		goto err_tmpl;
+	}
+
 	kobj = kobject_create_and_add("genltest", kobj);
 	if (unlikely(!kobj)) {
 		pr_err("unable to create kobject\n");
-		return -ENOMEM;
+		ret = -ENOMEM;
+		goto err_pernet;
 	}
-	ret = sysfs_create_file(kobj, &ping_attr.attr);
+	ret = sysfs_create_group(kobj, &genltest_attr_group);
 	if (unlikely(ret)) {
-		pr_err("unable to create sysfs file\n");
-		kobject_put(kobj);
-		return ret;
+		pr_err("unable to create sysfs files\n");
+		goto err_kobj;
+	}
+	ret = misc_register(&genltest_misc);
+	if (unlikely(ret)) {
+		pr_err("unable to register misc device\n");
+		goto err_sysfs;
 	}
 
 	ret = genl_register_family(&genl_fam);
 	if (unlikely(ret)) {
 		pr_crit("failed to register generic netlink family\n");
-		sysfs_remove_file(kobj, &ping_attr.attr);
-		kobject_put(kobj);
+		goto err_misc;
 	}
+	lat_debugfs_init();
 
 	pr_info("init end\n");
 
+	return 0;
+
+err_misc:
+	misc_deregister(&genltest_misc);
+err_sysfs:
+	sysfs_remove_group(kobj, &genltest_attr_group);
+	ping_burst_stop();
+	ping_queue_flush();
+	ring_flush();
+err_kobj:
+	kobject_put(kobj);
+err_pernet:
+	unregister_pernet_subsys(&genltest_net_ops);
+err_tmpl:
+	nlmsg_free(echo_reply_tmpl);
+err_ring:
+	ring_exit();
 	return ret;
 }
 
 static void __exit exit_genltest(void)
 {
+	debugfs_remove_recursive(lat_dir);
+
+	/* No more pings from now on, then we can get rid of the family */
+	misc_deregister(&genltest_misc);
+	sysfs_remove_group(kobj, &genltest_attr_group);
+	ping_burst_stop();
+	ping_queue_flush();
+	ring_flush();
+
 	if (unlikely(genl_unregister_family(&genl_fam))) {
 		pr_err("failed to unregister generic netlink family\n");
 	}
 
-	sysfs_remove_file(kobj, &ping_attr.attr);
 	kobject_put(kobj);
+	unregister_pernet_subsys(&genltest_net_ops);
+	nlmsg_free(echo_reply_tmpl);
+	ring_exit();
 
 	pr_info("exit\n");
 }
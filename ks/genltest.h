@@ -1,31 +1,79 @@
 #ifndef GENLTEST_H
 #define GENLTEST_H
 
+#include <linux/types.h>
+
 /*
  * This header includes definitions that are shared with kernel space and user
  * space. This header would be put in a place visible to user space.
  */
 
-#define GENLTEST_GENL_NAME "genltest"
-#define GENLTEST_GENL_VERSION 1
-#define GENLTEST_MC_GRP_NAME "mcgrp"
+/*
+ * The family itself, its groups, attributes and commands, are described by
+ * spec/genltest.yaml, which genltest_nl.h is generated from.
+ */
+#include "genltest_nl.h"
 
-/* Attributes */
-enum genltest_attrs {
-	GENLTEST_A_UNSPEC,
-	GENLTEST_A_MSG,
-	__GENLTEST_A_MAX,
-};
+/*
+ * Per-node groups, GENLTEST_MCGRP_NODE0 and on. With the ping_numa param set,
+ * whatever is pinged to GENLTEST_MCGRP_DEFAULT from a CPU of node n goes to
+ * GENLTEST_MCGRP_NODE0 + n % GENLTEST_MCGRP_NODES instead, as long as somebody
+ * is listening there, so that listeners pinned to that node get it without it
+ * ever leaving the node.
+ */
+#define GENLTEST_MCGRP_NODES (GENLTEST_MCGRP_NODE3 - GENLTEST_MCGRP_NODE0 + 1)
 
-#define GENLTEST_A_MAX (__GENLTEST_A_MAX - 1)
+/*
+ * Misc device, /dev/genltest, every segment written to it is pinged to the
+ * multicast group. It's also where the shared rings are mmap()ed from.
+ */
+#define GENLTEST_DEV_NAME "genltest"
+
+/*
+ * Shared rings, for pings at rates where even multicast is too expensive.
+ * When the module is loaded with ring_pages, /dev/genltest can be mmap()ed
+ * with all of the rings, one per possible CPU and one after the other. Each
+ * of them is a page with a struct genltest_ring, followed by
+ * GENLTEST_A_RING_SIZE bytes of records. Pings go into the ring of the CPU
+ * that they are sent from, so every ring has a single producer, and a single
+ * consumer is expected to read all of them.
+ *
+ * head and tail are offsets in bytes that only ever grow, wrapping around at
+ * 32 bits, and the record at either of them is at their value modulo the size
+ * of the ring, which is a power of two. The kernel publishes new records by
+ * moving head with release semantics, and the consumer frees them by doing
+ * the same with tail. Records are never split: one that doesn't fit before the
+ * end of the ring goes at the start, after a GENLTEST_RING_PAD record filling
+ * what's left.
+ */
+struct genltest_ring {
+	/* Written by the kernel */
+	__u32 head;
+	__u32 __pad0;
+	__u64 dropped;
+	__u8  __pad1[48];
+	/* Written by the consumer */
+	__u32 tail;
+	/*
+	 * Set to non-zero before sleeping in poll(), so that the kernel
+	 * knows that it has to wake it up. It's cleared by the kernel when it
+	 * does. Without it, producers never touch the wait queue.
+	 */
+	__u32 waiting;
+	__u8  __pad2[56];
+};
 
-/* Commands */
-enum genltest_cmds {
-	GENLTEST_CMD_UNSPEC,
-	GENLTEST_CMD_ECHO,
-	__GENLTEST_CMD_MAX,
+struct genltest_ring_rec {
+	/* Of the whole record, header included, a multiple of 8 bytes */
+	__u32 len;
+	/* enum genltest_mcgrps, or GENLTEST_RING_PAD for padding */
+	__u16 group;
+	/* Length of data, which is not NUL terminated */
+	__u16 data_len;
+	char  data[];
 };
 
-#define GENLTEST_CMD_MAX (__GENLTEST_CMD_MAX - 1)
+#define GENLTEST_RING_PAD	0xffff
+#define GENLTEST_RING_REC_ALIGN 8
 
-#endif 
+#endif
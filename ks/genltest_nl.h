@@ -0,0 +1,183 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Do not edit directly, auto-generated from: */
+/*	spec/genltest.yaml */
+/* by spec/genltest-gen.py, the enums and names of the family */
+
+#ifndef GENLTEST_NL_H
+#define GENLTEST_NL_H
+
+#define GENLTEST_GENL_NAME "genltest"
+#define GENLTEST_GENL_VERSION 1
+#define GENLTEST_MC_GRP_NAME "mcgrp"
+#define GENLTEST_MC_GRP_URGENT_NAME "urgent"
+#define GENLTEST_MC_GRP_BULK_NAME "bulk"
+#define GENLTEST_MC_GRP_NODE0_NAME "node0"
+#define GENLTEST_MC_GRP_NODE1_NAME "node1"
+#define GENLTEST_MC_GRP_NODE2_NAME "node2"
+#define GENLTEST_MC_GRP_NODE3_NAME "node3"
+
+/*
+ * Multicast groups. Notifications are sent to one of them, so that listeners
+ * can join only the ones they care about instead of filtering everything.
+ */
+enum genltest_mcgrps {
+	/* GENLTEST_MC_GRP_NAME, where notifications go if not told otherwise */
+	GENLTEST_MCGRP_DEFAULT,
+	/* GENLTEST_MC_GRP_URGENT_NAME, for the few that can't wait */
+	GENLTEST_MCGRP_URGENT,
+	/* GENLTEST_MC_GRP_BULK_NAME, for high volume, low priority ones */
+	GENLTEST_MCGRP_BULK,
+	/* GENLTEST_MC_GRP_NODE0_NAME, pings produced on the first node */
+	GENLTEST_MCGRP_NODE0,
+	GENLTEST_MCGRP_NODE1,
+	GENLTEST_MCGRP_NODE2,
+	GENLTEST_MCGRP_NODE3,
+	__GENLTEST_MCGRP_MAX,
+};
+
+#define GENLTEST_MCGRP_MAX (__GENLTEST_MCGRP_MAX - 1)
+
+/* Maximum length of GENLTEST_A_DATA */
+#define GENLTEST_DATA_MAX_LEN 32768
+
+/* Number of log2 buckets of each latency histogram */
+#define GENLTEST_LATENCY_BUCKETS 32
+
+/* Attributes */
+enum genltest_attrs {
+	GENLTEST_A_UNSPEC,
+	GENLTEST_A_MSG,
+	/* Nested array of GENLTEST_A_MSG, used by GENLTEST_CMD_ECHO_BATCH */
+	GENLTEST_A_BATCH,
+	/* Number of records requested in a GENLTEST_CMD_ECHO dump (u32) */
+	GENLTEST_A_COUNT,
+	/* Nest of genltest_stats_attrs, replied to GENLTEST_CMD_GET_STATS */
+	GENLTEST_A_STATS,
+	/*
+	 * Sequence number of multicast notifications (u32), so that listeners
+	 * can tell how many of them they missed.
+	 */
+	GENLTEST_A_SEQ,
+	/* Binary payload, echoed back as is by GENLTEST_CMD_ECHO */
+	GENLTEST_A_DATA,
+	/*
+	 * Multicast group (u32, enum genltest_mcgrps) that a notification was
+	 * sent to. Each group has its own GENLTEST_A_SEQ.
+	 */
+	GENLTEST_A_MCGRP,
+	/* Padding for the 64-bit attributes */
+	GENLTEST_A_PAD,
+	/*
+	 * Groups whose pings also go into the shared rings (u32, one bit per
+	 * enum genltest_mcgrps), see GENLTEST_CMD_RING.
+	 */
+	GENLTEST_A_RING_GROUPS,
+	/* Bytes of records of each ring (u32) */
+	GENLTEST_A_RING_SIZE,
+	/* Number of rings, one per possible CPU (u32) */
+	GENLTEST_A_RING_COUNT,
+	/*
+	 * Records dropped for lack of room (u64), in all of the rings, or in
+	 * the one of GENLTEST_A_RING_INDEX if there's one.
+	 */
+	GENLTEST_A_RING_DROPPED,
+	/* Ring that overflowed (u32) */
+	GENLTEST_A_RING_INDEX,
+	/*
+	 * Don't reply to a GENLTEST_CMD_ECHO (flag). Only errors are sent back,
+	 * and an ACK if NLM_F_ACK is set, so that bulk senders don't get a
+	 * message for each one of theirs.
+	 */
+	GENLTEST_A_NOREPLY,
+	/*
+	 * Latency histogram of a stage of the hot paths, one of these for each
+	 * stage with samples, replied to GENLTEST_CMD_GET_STATS.
+	 */
+	GENLTEST_A_LATENCY,
+	__GENLTEST_A_MAX,
+};
+
+#define GENLTEST_A_MAX (__GENLTEST_A_MAX - 1)
+
+/* Statistics counters (u64), nested inside of GENLTEST_A_STATS */
+enum genltest_stats_attrs {
+	GENLTEST_STATS_A_UNSPEC,
+	GENLTEST_STATS_A_PAD,
+	/* Messages echoed back */
+	GENLTEST_STATS_A_ECHO,
+	/* Multicast messages sent */
+	GENLTEST_STATS_A_MC_SENT,
+	/* Multicast messages dropped because nobody was listening */
+	GENLTEST_STATS_A_MC_NOLISTEN,
+	/* Multicast messages that failed to be sent for any other reason */
+	GENLTEST_STATS_A_MC_FAILED,
+	/* Failures to allocate a message */
+	GENLTEST_STATS_A_ENOMEM,
+	/* Failures to fit something inside of a message */
+	GENLTEST_STATS_A_EMSGSIZE,
+	/* Bytes of netlink messages received and sent */
+	GENLTEST_STATS_A_RX_BYTES,
+	GENLTEST_STATS_A_TX_BYTES,
+	/* Pings that were coalesced with others into one multicast message */
+	GENLTEST_STATS_A_MC_COALESCED,
+	/* Pings dropped because the asynchronous queue was full */
+	GENLTEST_STATS_A_MC_QFULL,
+	/* Pings not even built because nobody was listening to their group */
+	GENLTEST_STATS_A_MC_SKIPPED,
+	/* Pings written into the shared rings */
+	GENLTEST_STATS_A_RING_SENT,
+	/* Pings dropped because their ring was full */
+	GENLTEST_STATS_A_RING_DROPPED,
+	/* Pings refused with EAGAIN for going over the rate of their group */
+	GENLTEST_STATS_A_MC_THROTTLED,
+	/* Pings that had to wait for the rate of their group to allow them */
+	GENLTEST_STATS_A_MC_WAITED,
+	__GENLTEST_STATS_A_MAX,
+};
+
+#define GENLTEST_STATS_A_MAX (__GENLTEST_STATS_A_MAX - 1)
+
+/* Latency histogram of a stage, nested inside of GENLTEST_A_LATENCY */
+enum genltest_latency_attrs {
+	GENLTEST_LATENCY_A_UNSPEC,
+	GENLTEST_LATENCY_A_PAD,
+	/* Name of the stage, as in debugfs */
+	GENLTEST_LATENCY_A_STAGE,
+	/* Number of samples (u64) */
+	GENLTEST_LATENCY_A_COUNT,
+	/* Sum of the samples, in ns (u64) */
+	GENLTEST_LATENCY_A_SUM,
+	/*
+	 * Samples in each bucket (u64 array of GENLTEST_LATENCY_BUCKETS).
+	 * Bucket i has the ones from 2^i to 2^(i + 1) - 1 ns, the first one
+	 * also those of 0 ns, and the last one all of the longer ones.
+	 */
+	GENLTEST_LATENCY_A_BUCKETS,
+	__GENLTEST_LATENCY_A_MAX,
+};
+
+#define GENLTEST_LATENCY_A_MAX (__GENLTEST_LATENCY_A_MAX - 1)
+
+/* Commands */
+enum genltest_cmds {
+	GENLTEST_CMD_UNSPEC,
+	GENLTEST_CMD_ECHO,
+	GENLTEST_CMD_ECHO_BATCH,
+	GENLTEST_CMD_GET_STATS,
+	/*
+	 * Control of the shared rings. With GENLTEST_A_RING_GROUPS, pings to
+	 * those groups in the namespace of the sender go into the rings from
+	 * then on, in place of whatever was asked for before. The reply has the
+	 * size, count, groups and drops of the rings. The same command is
+	 * multicast to GENLTEST_MCGRP_URGENT when a ring overflows. There is
+	 * only one set of rings for the whole host, so asking for them takes
+	 * CAP_NET_ADMIN in the initial user namespace, not just in that of the
+	 * namespace of the sender.
+	 */
+	GENLTEST_CMD_RING,
+	__GENLTEST_CMD_MAX,
+};
+
+#define GENLTEST_CMD_MAX (__GENLTEST_CMD_MAX - 1)
+
+#endif /* GENLTEST_NL_H */
@@ -0,0 +1,114 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Do not edit directly, auto-generated from: */
+/*	spec/genltest.yaml */
+/* by spec/genltest-gen.py, the policies, ops and groups of the module */
+
+/*
+ * Only meant to be included once, by genltest.c, where it replaces what would
+ * otherwise be written by hand. The handlers that the ops name are then up to
+ * it to define.
+ */
+#ifndef GENLTEST_NL_KERN_H
+#define GENLTEST_NL_KERN_H
+
+#include <net/genetlink.h>
+
+#include "genltest.h"
+
+/* Handlers of the ops */
+static int echo_doit(struct sk_buff *skb, struct genl_info *info);
+static int echo_dump_start(struct netlink_callback *cb);
+static int echo_dumpit(struct sk_buff *skb,
+		       struct netlink_callback *cb);
+static int echo_dump_done(struct netlink_callback *cb);
+static int echo_batch_doit(struct sk_buff *skb, struct genl_info *info);
+static int get_stats_doit(struct sk_buff *skb, struct genl_info *info);
+static int ring_doit(struct sk_buff *skb, struct genl_info *info);
+
+/* Attributes in a nest of batch-entry */
+static const struct nla_policy
+genltest_batch_entry_nl_policy[GENLTEST_A_MAX + 1] = {
+	[GENLTEST_A_MSG]  = { .type = NLA_NUL_STRING },
+	[GENLTEST_A_DATA] = { .type = NLA_BINARY,
+			      .len  = GENLTEST_DATA_MAX_LEN },
+};
+
+/* GENLTEST_CMD_ECHO - do and dump */
+static const struct nla_policy genltest_echo_nl_policy[GENLTEST_A_MAX + 1] = {
+	[GENLTEST_A_MSG]     = { .type = NLA_NUL_STRING },
+	[GENLTEST_A_DATA]    = { .type = NLA_BINARY,
+				 .len  = GENLTEST_DATA_MAX_LEN },
+	[GENLTEST_A_NOREPLY] = { .type = NLA_FLAG },
+	[GENLTEST_A_COUNT]   = { .type = NLA_U32 },
+};
+
+/* GENLTEST_CMD_ECHO_BATCH */
+static const struct nla_policy
+genltest_echo_batch_nl_policy[GENLTEST_A_MAX + 1] = {
+	[GENLTEST_A_BATCH] = NLA_POLICY_NESTED(genltest_batch_entry_nl_policy),
+};
+
+/* GENLTEST_CMD_RING */
+static const struct nla_policy genltest_ring_nl_policy[GENLTEST_A_MAX + 1] = {
+	[GENLTEST_A_RING_GROUPS] =
+		NLA_POLICY_MASK(NLA_U32, GENMASK(GENLTEST_MCGRP_MAX, 0)),
+};
+
+/* Ops of the family */
+static const struct genl_ops genltest_nl_ops[] = {
+	{
+		.cmd	= GENLTEST_CMD_ECHO,
+		.policy = genltest_echo_nl_policy,
+		.doit	= echo_doit,
+		.start	= echo_dump_start,
+		.dumpit = echo_dumpit,
+		.done	= echo_dump_done,
+	},
+	{
+		.cmd	= GENLTEST_CMD_ECHO_BATCH,
+		.policy = genltest_echo_batch_nl_policy,
+		.doit	= echo_batch_doit,
+	},
+	{
+		.cmd  = GENLTEST_CMD_GET_STATS,
+		.doit = get_stats_doit,
+	},
+	{
+		.cmd	= GENLTEST_CMD_RING,
+		.policy = genltest_ring_nl_policy,
+		.doit	= ring_doit,
+		.flags	= GENL_ADMIN_PERM,
+	},
+};
+
+/* Multicast groups of the family */
+static const struct genl_multicast_group genltest_nl_mcgrps[] = {
+	[GENLTEST_MCGRP_DEFAULT] = { .name = GENLTEST_MC_GRP_NAME },
+	[GENLTEST_MCGRP_URGENT]	 = { .name = GENLTEST_MC_GRP_URGENT_NAME },
+	[GENLTEST_MCGRP_BULK]	 = { .name = GENLTEST_MC_GRP_BULK_NAME },
+	[GENLTEST_MCGRP_NODE0]	 = { .name = GENLTEST_MC_GRP_NODE0_NAME },
+	[GENLTEST_MCGRP_NODE1]	 = { .name = GENLTEST_MC_GRP_NODE1_NAME },
+	[GENLTEST_MCGRP_NODE2]	 = { .name = GENLTEST_MC_GRP_NODE2_NAME },
+	[GENLTEST_MCGRP_NODE3]	 = { .name = GENLTEST_MC_GRP_NODE3_NAME },
+};
+
+/* Names of the attributes of genltest_stats_attrs */
+static const char *const genltest_stats_names[GENLTEST_STATS_A_MAX + 1] = {
+	[GENLTEST_STATS_A_ECHO]		= "echo",
+	[GENLTEST_STATS_A_MC_SENT]	= "mc_sent",
+	[GENLTEST_STATS_A_MC_NOLISTEN]	= "mc_nolisten",
+	[GENLTEST_STATS_A_MC_FAILED]	= "mc_failed",
+	[GENLTEST_STATS_A_ENOMEM]	= "enomem",
+	[GENLTEST_STATS_A_EMSGSIZE]	= "emsgsize",
+	[GENLTEST_STATS_A_RX_BYTES]	= "rx_bytes",
+	[GENLTEST_STATS_A_TX_BYTES]	= "tx_bytes",
+	[GENLTEST_STATS_A_MC_COALESCED] = "mc_coalesced",
+	[GENLTEST_STATS_A_MC_QFULL]	= "mc_qfull",
+	[GENLTEST_STATS_A_MC_SKIPPED]	= "mc_skipped",
+	[GENLTEST_STATS_A_RING_SENT]	= "ring_sent",
+	[GENLTEST_STATS_A_RING_DROPPED] = "ring_dropped",
+	[GENLTEST_STATS_A_MC_THROTTLED] = "mc_throttled",
+	[GENLTEST_STATS_A_MC_WAITED]	= "mc_waited",
+};
+
+#endif /* GENLTEST_NL_KERN_H */
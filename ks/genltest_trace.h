@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Tracepoints for the Generic Netlink example module
+ *
+ * Printing every message that goes through the module is way too expensive
+ * when there's a lot of them, tracepoints instead cost nothing unless they are
+ * enabled, e.g.:
+ *
+ *   # echo 1 > /sys/kernel/tracing/events/genltest/enable
+ *   # cat /sys/kernel/tracing/trace_pipe
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM genltest
+
+#if !defined(GENLTEST_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define GENLTEST_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* A request was received from user space */
+TRACE_EVENT(genltest_echo_recv,
+
+	TP_PROTO(u32 portid, u8 cmd, size_t len),
+
+	TP_ARGS(portid, cmd, len),
+
+	TP_STRUCT__entry(
+		__field(u32,	portid)
+		__field(u8,	cmd)
+		__field(size_t,	len)
+	),
+
+	TP_fast_assign(
+		__entry->portid = portid;
+		__entry->cmd	= cmd;
+		__entry->len	= len;
+	),
+
+	TP_printk("portid=%u cmd=%u len=%zu", __entry->portid, __entry->cmd,
+		  __entry->len)
+);
+
+/* A reply was sent back to user space */
+TRACE_EVENT(genltest_echo_reply,
+
+	TP_PROTO(u32 portid, size_t len, int ret),
+
+	TP_ARGS(portid, len, ret),
+
+	TP_STRUCT__entry(
+		__field(u32,	portid)
+		__field(size_t,	len)
+		__field(int,	ret)
+	),
+
+	TP_fast_assign(
+		__entry->portid = portid;
+		__entry->len	= len;
+		__entry->ret	= ret;
+	),
+
+	TP_printk("portid=%u len=%zu ret=%d", __entry->portid, __entry->len,
+		  __entry->ret)
+);
+
+/* A message was sent, or at least we tried to, to a multicast group */
+TRACE_EVENT(genltest_mc_send,
+
+	TP_PROTO(unsigned int group, size_t len, int ret),
+
+	TP_ARGS(group, len, ret),
+
+	TP_STRUCT__entry(
+		__field(unsigned int,	group)
+		__field(size_t,		len)
+		__field(int,		ret)
+	),
+
+	TP_fast_assign(
+		__entry->group = group;
+		__entry->len   = len;
+		__entry->ret   = ret;
+	),
+
+	TP_printk("group=%u len=%zu ret=%d", __entry->group, __entry->len,
+		  __entry->ret)
+);
+
+#endif /* GENLTEST_TRACE_H */
+
+/* This part must be outside of the include guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE genltest_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,645 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0
+#
+# Generator of the C code of the genltest family from its spec, a much smaller
+# take on tools/net/ynl/ynl-gen-c.py of the kernel, for the parts of YNL that
+# the spec uses and what this repo needs:
+#
+#   genltest-gen.py --mode uapi genltest.yaml > ../ks/genltest_nl.h
+#   genltest-gen.py --mode kernel genltest.yaml > ../ks/genltest_nl_kern.h
+#   genltest-gen.py --mode user genltest.yaml > ../us/genltest_nl_user.h
+#
+# The output is meant to be committed, so that building doesn't need Python,
+# and to look like the rest of the code, so it's indented with tabs and aligned
+# the same way.
+
+import argparse
+import os
+import sys
+import textwrap
+
+import yaml
+
+# How each type of attribute is validated by the kernel
+NLA_TYPES = {
+    'u8': 'NLA_U8',
+    'u16': 'NLA_U16',
+    'u32': 'NLA_U32',
+    'u64': 'NLA_U64',
+    'string': 'NLA_NUL_STRING',
+    'binary': 'NLA_BINARY',
+    'flag': 'NLA_FLAG',
+    'nest': 'NLA_NESTED',
+}
+
+# C types of the scalar attributes, which user space parses into their value
+SCALAR_TYPES = {'u8': '__u8', 'u16': '__u16', 'u32': '__u32', 'u64': '__u64'}
+
+# genl_ops flags of the spec
+OP_FLAGS = {
+    'admin-perm': 'GENL_ADMIN_PERM',
+    'uns-admin-perm': 'GENL_UNS_ADMIN_PERM',
+}
+
+
+def c_name(name):
+    return name.replace('-', '_')
+
+
+def c_upper(name):
+    return c_name(name).upper()
+
+
+def col(s):
+    """Column that s ends at, with tabs of 8"""
+    n = 0
+    for c in s:
+        n = (n // 8 + 1) * 8 if c == '\t' else n + 1
+    return n
+
+
+def pad_to(s, target):
+    """
+    Pad s up to column target, with tabs as far as they go, then spaces, like
+    clang-format does with UseTab: Always. A single space is always a space.
+    """
+    n = col(s)
+    if target - n == 1:
+        return s + ' '
+    while (n // 8 + 1) * 8 <= target:
+        s += '\t'
+        n = (n // 8 + 1) * 8
+    return s + ' ' * (target - n)
+
+
+def aligned(indent, pairs, end=','):
+    """
+    Lines of indent + key = value, with = aligned for all of them, and values
+    that don't fit in 80 columns broken up: initializers one field per line,
+    anything else on a line of its own.
+    """
+    width = max(col(indent + k) for k, _ in pairs) + 1
+    lines = []
+    for k, v in pairs:
+        line = pad_to(indent + k, width) + '= ' + v + end
+        if col(line) <= 80:
+            lines.append(line)
+        elif v.startswith('{ '):
+            fields = [f.split(' = ') for f in v[2:-2].split(', ')]
+            lines += aligned(pad_to('', width + 4), fields)
+            lines[-len(fields)] = (pad_to(indent + k, width) + '= { ' +
+                                   lines[-len(fields)].lstrip())
+            lines[-1] = lines[-1][:-1] + ' }' + end
+        else:
+            lines += [indent + k + ' =', indent + '\t' + v + end]
+    return lines
+
+
+def decl(head, rest):
+    """head rest, or rest on a line of its own if it doesn't fit in 80"""
+    line = head + ' ' + rest
+    return [line] if col(line) <= 80 else [head, rest]
+
+
+def comment(doc, indent=''):
+    """A comment with doc, on a single line if it fits in 80 columns"""
+    if not doc:
+        return []
+    text = ' '.join(doc.split())
+    if col(indent + '/* ' + text + ' */') <= 80:
+        return [indent + '/* ' + text + ' */']
+    width = 80 - col(indent + ' * ')
+    return ([indent + '/*'] +
+            [indent + ' * ' + line for line in textwrap.wrap(text, width)] +
+            [indent + ' */'])
+
+
+class Family:
+    def __init__(self, spec):
+        self.spec = spec
+        self.name = spec['name']
+        self.prefix = c_upper(self.name) + '_'
+        self.consts = {d['name']: d for d in spec.get('definitions', [])
+                       if d['type'] == 'const'}
+        self.mcgrps = spec['mcast-groups']
+        self.sets = {s['name']: s for s in spec['attribute-sets']}
+        self.ops = spec['operations']
+
+        # Subsets take the definitions of the attributes from their set
+        for s in self.sets.values():
+            if 'subset-of' not in s:
+                continue
+            full = {a['name']: a for a in
+                    self.sets[s['subset-of']]['attributes']}
+            s['attributes'] = [dict(full[a['name']], **a)
+                               for a in s['attributes']]
+
+    def const(self, name):
+        return self.prefix + c_upper(name)
+
+    def top_set(self, s):
+        return self.sets[s.get('subset-of', s['name'])]
+
+    def attr_enum(self, s, attr):
+        return self.top_set(s)['name-prefix'] + c_upper(attr['name'])
+
+    def attr_max(self, s):
+        return self.top_set(s)['name-prefix'] + 'MAX'
+
+    def mcgrp_enum(self, grp):
+        return (self.mcgrps['name-prefix'] +
+                c_upper(grp.get('c-enum-name', grp['name'])))
+
+    def mcgrp_max(self):
+        return self.mcgrps['name-prefix'] + 'MAX'
+
+    def op_enum(self, op):
+        return self.ops['name-prefix'] + c_upper(op['name'])
+
+    def policy_name(self, name):
+        return '%s_%s_nl_policy' % (c_name(self.name), c_name(name))
+
+    def op_policy_attrs(self, op):
+        """Attributes of the requests of op, do and dump share one policy"""
+        names = []
+        for kind in ('do', 'dump'):
+            req = op.get(kind, {}).get('request', {})
+            names += [a for a in req.get('attributes', []) if a not in names]
+        return names
+
+    def header(self, out, what):
+        out += ['/* SPDX-License-Identifier: GPL-2.0 */',
+                '/* Do not edit directly, auto-generated from: */',
+                '/*\tspec/%s.yaml */' % self.name,
+                '/* by spec/genltest-gen.py, %s */' % what, '']
+
+
+def render_enum(out, name, entries, max_name=None):
+    """enum name with (c name, doc) entries, and its _MAX if max_name"""
+    out.append('enum %s {' % name)
+    for entry, doc in entries:
+        out += comment(doc, '\t')
+        out.append('\t%s,' % entry)
+    if max_name:
+        out.append('\t__%s,' % max_name)
+    out.append('};')
+    if max_name:
+        out += ['', '#define %s (__%s - 1)' % (max_name, max_name)]
+    out.append('')
+
+
+def gen_uapi(fam):
+    out = []
+    guard = fam.prefix + 'NL_H'
+    fam.header(out, 'the enums and names of the family')
+    out += ['#ifndef ' + guard, '#define ' + guard, '']
+
+    out += ['#define %sGENL_NAME "%s"' % (fam.prefix, fam.name),
+            '#define %sGENL_VERSION %d' % (fam.prefix, fam.spec['version'])]
+    for grp in fam.mcgrps['list']:
+        out.append('#define %s "%s"' % (grp['c-define-name'], grp['name']))
+    out.append('')
+
+    out += comment(fam.mcgrps.get('doc'))
+    render_enum(out, fam.mcgrps['enum-name'],
+                [(fam.mcgrp_enum(g), g.get('doc'))
+                 for g in fam.mcgrps['list']], fam.mcgrp_max())
+
+    for c in fam.consts.values():
+        out += comment(c.get('doc'))
+        out += ['#define %s %s' % (fam.const(c['name']), c['value']), '']
+
+    for s in fam.sets.values():
+        if 'subset-of' in s:
+            continue
+        out += comment(s.get('doc'))
+        entries = [(s['name-prefix'] + 'UNSPEC', None)]
+        entries += [(fam.attr_enum(s, a), a.get('doc'))
+                    for a in s['attributes']]
+        render_enum(out, s['enum-name'], entries, fam.attr_max(s))
+
+    out += comment(fam.ops.get('doc'))
+    entries = [(fam.ops['name-prefix'] + 'UNSPEC', None)]
+    entries += [(fam.op_enum(op), op.get('doc')) for op in fam.ops['list']]
+    render_enum(out, fam.ops['enum-name'], entries,
+                fam.ops['name-prefix'] + 'MAX')
+
+    out += ['#endif /* %s */' % guard]
+    return out
+
+
+def kernel_policy_entry(fam, s, attr):
+    checks = attr.get('checks', {})
+    if attr['type'] == 'nest':
+        return 'NLA_POLICY_NESTED(%s)' % fam.policy_name(
+            attr['nested-attributes'])
+    if attr.get('enum-as-flags'):
+        return 'NLA_POLICY_MASK(%s, GENMASK(%s, 0))' % (
+            NLA_TYPES[attr['type']], fam.mcgrp_max())
+    if 'max-len' in checks:
+        # Not NLA_POLICY_MAX_LEN(), its max is only 16 bits, and signed
+        return '{ .type = %s, .len = %s }' % (
+            NLA_TYPES[attr['type']], fam.const(checks['max-len']))
+    return '{ .type = %s }' % NLA_TYPES[attr['type']]
+
+
+def render_policy(out, fam, s, name, attrs):
+    out += decl('static const struct nla_policy',
+                '%s[%s + 1] = {' % (name, fam.attr_max(s)))
+    out += aligned('\t', [('[%s]' % fam.attr_enum(s, a),
+                           kernel_policy_entry(fam, s, a)) for a in attrs])
+    out += ['};', '']
+
+
+def gen_kernel(fam):
+    out = []
+    guard = fam.prefix + 'NL_KERN_H'
+    fam.header(out, 'the policies, ops and groups of the module')
+    out += comment('Only meant to be included once, by genltest.c, where it '
+                   'replaces what would otherwise be written by hand. The '
+                   'handlers that the ops name are then up to it to define.')
+    out += ['#ifndef ' + guard, '#define ' + guard, '',
+            '#include <net/genetlink.h>', '', '#include "genltest.h"', '']
+
+    out.append('/* Handlers of the ops */')
+    for op in fam.ops['list']:
+        name = c_name(op['name'])
+        if 'do' in op:
+            out.append('static int %s_doit(struct sk_buff *skb, '
+                       'struct genl_info *info);' % name)
+        if 'dump' in op:
+            dump = op['dump']
+            if 'pre' in dump:
+                out.append('static int %s(struct netlink_callback *cb);' %
+                           c_name(dump['pre']))
+            out += ['static int %s_dumpit(struct sk_buff *skb,' % name,
+                    pad_to('', col('static int %s_dumpit(' % name)) +
+                    'struct netlink_callback *cb);']
+            if 'post' in dump:
+                out.append('static int %s(struct netlink_callback *cb);' %
+                           c_name(dump['post']))
+    out.append('')
+
+    # Subsets are for what goes in nests, the policies of the ops point to them
+    for s in fam.sets.values():
+        if 'subset-of' not in s:
+            continue
+        out += comment('Attributes in a nest of %s' % s['name'])
+        render_policy(out, fam, s, fam.policy_name(s['name']),
+                      s['attributes'])
+
+    for op in fam.ops['list']:
+        s = fam.sets[op['attribute-set']]
+        names = fam.op_policy_attrs(op)
+        if not names:
+            continue
+        by_name = {a['name']: a for a in s['attributes']}
+        out += comment('%s%s' % (fam.op_enum(op), ' - do and dump'
+                                 if 'do' in op and 'dump' in op else ''))
+        render_policy(out, fam, s, fam.policy_name(op['name']),
+                      [by_name[n] for n in names])
+
+    out.append('/* Ops of the family */')
+    out.append('static const struct genl_ops %s_nl_ops[] = {' %
+               c_name(fam.name))
+    for op in fam.ops['list']:
+        name = c_name(op['name'])
+        fields = [('.cmd', fam.op_enum(op))]
+        if fam.op_policy_attrs(op):
+            fields.append(('.policy', fam.policy_name(op['name'])))
+        if 'do' in op:
+            fields.append(('.doit', name + '_doit'))
+        if 'dump' in op:
+            dump = op['dump']
+            if 'pre' in dump:
+                fields.append(('.start', c_name(dump['pre'])))
+            fields.append(('.dumpit', name + '_dumpit'))
+            if 'post' in dump:
+                fields.append(('.done', c_name(dump['post'])))
+        if op.get('flags'):
+            fields.append(('.flags', ' | '.join(OP_FLAGS[f]
+                                                for f in op['flags'])))
+        out.append('\t{')
+        out += aligned('\t\t', fields)
+        out.append('\t},')
+    out += ['};', '']
+
+    out.append('/* Multicast groups of the family */')
+    out.append('static const struct genl_multicast_group %s_nl_mcgrps[] = {' %
+               c_name(fam.name))
+    out += aligned('\t', [('[%s]' % fam.mcgrp_enum(g),
+                           '{ .name = %s }' % g['c-define-name'])
+                          for g in fam.mcgrps['list']])
+    out += ['};', '']
+
+    gen_names(out, fam)
+
+    out += ['#endif /* %s */' % guard]
+    return out
+
+
+def gen_names(out, fam):
+    """Tables of the names of the attributes of the sets with render-names"""
+    for s in fam.sets.values():
+        if not s.get('render-names'):
+            continue
+        out += comment('Names of the attributes of %s' % s['enum-name'])
+        out.append('static const char *const %s_%s_names[%s + 1] = {' %
+                   (c_name(fam.name), c_name(s['name']), fam.attr_max(s)))
+        out += aligned('\t', [('[%s]' % fam.attr_enum(s, a),
+                               '"%s"' % c_name(a['name']))
+                              for a in s['attributes']
+                              if a['type'] != 'pad'])
+        out += ['};', '']
+
+
+USER_HELPERS = '''
+/*
+ * Walking the attributes in a buffer of len bytes, stopping at the first one
+ * that goes out of bounds.
+ */
+static inline int genltest_nla_ok(const struct nlattr *nla, int rem)
+{
+	return rem >= (int)sizeof(*nla) && nla->nla_len >= sizeof(*nla) &&
+	       nla->nla_len <= rem;
+}
+
+static inline const struct nlattr *genltest_nla_next(const struct nlattr *nla,
+						     int *rem)
+{
+	*rem -= NLA_ALIGN(nla->nla_len);
+	return (const struct nlattr *)((const char *)nla +
+				       NLA_ALIGN(nla->nla_len));
+}
+
+#define genltest_nla_for_each(nla, attrs, len, rem)                            \\
+	for ((nla) = (const struct nlattr *)(attrs), (rem) = (len);            \\
+	     genltest_nla_ok(nla, rem); (nla) = genltest_nla_next(nla, &(rem)))
+
+static inline const void *genltest_nla_data(const struct nlattr *nla)
+{
+	return (const char *)nla + NLA_HDRLEN;
+}
+
+static inline int genltest_nla_len(const struct nlattr *nla)
+{
+	return nla->nla_len - NLA_HDRLEN;
+}
+
+/* Attributes of a genl message at nlh, and how many bytes of them there are */
+static inline const void *genltest_attrs(const struct nlmsghdr *nlh)
+{
+	return (const char *)nlh + NLMSG_HDRLEN + GENL_HDRLEN;
+}
+
+static inline int genltest_attrs_len(const struct nlmsghdr *nlh)
+{
+	return (int)nlh->nlmsg_len - NLMSG_HDRLEN - GENL_HDRLEN;
+}
+
+/*
+ * Reserve room for an attribute of len bytes at the end of the message at nlh,
+ * which is in a buffer of size bytes. Returns where its payload goes, or NULL
+ * if it doesn't fit.
+ */
+static inline void *genltest_nla_reserve(struct nlmsghdr *nlh, size_t size,
+					 __u16 type, size_t len)
+{
+	struct nlattr *nla;
+	size_t	       off = NLMSG_ALIGN(nlh->nlmsg_len);
+
+	if (NLA_HDRLEN + len > 0xffff ||
+	    off + NLA_ALIGN(NLA_HDRLEN + len) > size) {
+		return NULL;
+	}
+
+	nla	      = (struct nlattr *)((char *)nlh + off);
+	nla->nla_type = type;
+	nla->nla_len  = NLA_HDRLEN + len;
+	memset((char *)nla + nla->nla_len, 0,
+	       NLA_ALIGN(nla->nla_len) - nla->nla_len);
+	nlh->nlmsg_len = off + NLA_ALIGN(nla->nla_len);
+
+	return (char *)nla + NLA_HDRLEN;
+}
+
+/*
+ * Nests, started by genltest_nest_start() with the type of the nest, and ended
+ * by genltest_nest_end() once their attributes are in.
+ */
+static inline struct nlattr *genltest_nest_start(struct nlmsghdr *nlh,
+						 size_t size, __u16 type)
+{
+	void *data = genltest_nla_reserve(nlh, size, type | NLA_F_NESTED, 0);
+
+	return data ? (struct nlattr *)((char *)data - NLA_HDRLEN) : NULL;
+}
+
+static inline void genltest_nest_end(struct nlmsghdr *nlh, struct nlattr *nest)
+{
+	nest->nla_len = (char *)nlh + nlh->nlmsg_len - (char *)nest;
+}
+'''
+
+
+def gen_user_parser(out, fam, s):
+    name = c_name(s['name'])
+    prefix = c_name(fam.name) + ('' if s['name'] == fam.name
+                                 else '_' + name)
+    attrs = [a for a in s['attributes'] if a['type'] != 'pad']
+    if len(attrs) >= 64:
+        sys.exit('%s: too many attributes for the present bits' % s['name'])
+
+    out += comment('Attributes of %s, as parsed by %s_parse(). Scalars are '
+                   'already in their own types, the rest point into the '
+                   'message. present has the bit of the type of each '
+                   'attribute that was found, see %s_has().' %
+                   (s['enum-name'], prefix, prefix))
+    out.append('struct %s_tb {' % prefix)
+    fields = [('__u64', 'present')]
+    for a in attrs:
+        if a['type'] in SCALAR_TYPES:
+            fields.append((SCALAR_TYPES[a['type']], c_name(a['name'])))
+        elif a['type'] == 'string':
+            fields.append(('const char', '*' + c_name(a['name'])))
+        elif a['type'] != 'flag':
+            fields.append(('const struct nlattr', '*' + c_name(a['name'])))
+    # Stars hang before the names, which are all aligned
+    width = max(col('\t' + t) for t, _ in fields) + 2
+    out += [pad_to('\t' + t, width - f.startswith('*')) + f + ';'
+            for t, f in fields]
+    out += ['};', '']
+
+    out += ['#define %s_has(tb, type) (((tb)->present >> (type)) & 1)' %
+            prefix, '']
+
+    out += comment('Parse the attributes of a message of %s, len bytes of '
+                   'them at attrs, into tb. Attributes have to be long enough '
+                   'for their type and strings NUL terminated, unknown ones '
+                   'are skipped. Returns 0, or -EINVAL if something is off.' %
+                   (s['enum-name']))
+    out += wrap_call('static inline int ', prefix + '_parse',
+                     ['struct %s_tb *tb' % prefix, 'const void *attrs',
+                      'int len'], '')
+    out += ['{',
+            '\tconst struct nlattr *nla;',
+            '\tint\t\t     rem;',
+            '',
+            '\ttb->present = 0;',
+            '\tgenltest_nla_for_each(nla, attrs, len, rem) {',
+            '\t\tunsigned int type = nla->nla_type & NLA_TYPE_MASK;',
+            '\t\tconst void  *data = genltest_nla_data(nla);',
+            '\t\tint\t     n\t  = genltest_nla_len(nla);',
+            '',
+            '\t\tswitch (type) {']
+    for a in attrs:
+        field = 'tb->' + c_name(a['name'])
+        out.append('\t\tcase %s:' % fam.attr_enum(s, a))
+        if a['type'] in SCALAR_TYPES:
+            ctype = SCALAR_TYPES[a['type']]
+            out += ['\t\t\tif (n < (int)sizeof(%s)) {' % ctype,
+                    '\t\t\t\treturn -EINVAL;', '\t\t\t}']
+            if a['type'] == 'u64':
+                out.append('\t\t\t/* Only 4 byte aligned without a pad */')
+                out.append('\t\t\tmemcpy(&%s, data, sizeof(%s));' %
+                           (field, ctype))
+            else:
+                out.append('\t\t\t%s = *(const %s *)data;' % (field, ctype))
+        elif a['type'] == 'string':
+            out += ['\t\t\tif (n < 1 || ((const char *)data)[n - 1]) {',
+                    '\t\t\t\treturn -EINVAL;', '\t\t\t}',
+                    '\t\t\t%s = data;' % field]
+        elif a['type'] == 'flag':
+            pass
+        else:
+            limit = a.get('checks', {}).get('max-len')
+            if limit:
+                out += ['\t\t\tif (n > %s) {' % fam.const(limit),
+                        '\t\t\t\treturn -EINVAL;', '\t\t\t}']
+            out.append('\t\t\t%s = nla;' % field)
+        out.append('\t\t\tbreak;')
+    out += ['\t\tdefault:',
+            '\t\t\tcontinue;',
+            '\t\t}',
+            '\t\ttb->present |= 1ULL << type;',
+            '\t}',
+            '',
+            '\treturn 0;',
+            '}',
+            '']
+
+
+def gen_user_encoders(out, fam, s):
+    out += comment('Encoders of the attributes of %s into the message at nlh, '
+                   'in a buffer of size bytes. They return 0, or -EMSGSIZE if '
+                   'the attribute doesn\'t fit.' % s['enum-name'])
+    for a in s['attributes']:
+        if a['type'] in ('pad', 'nest'):
+            continue
+        name = '%s_put_%s' % (c_name(fam.name), c_name(a['name']))
+        enum = fam.attr_enum(s, a)
+        decls = []
+        if a['type'] in SCALAR_TYPES:
+            args, len_, src = ['%s val' % SCALAR_TYPES[a['type']]], \
+                'sizeof(val)', '&val'
+        elif a['type'] == 'string':
+            args, len_, src = ['const char *str'], 'len', 'str'
+            decls.append(('size_t', 'len', 'strlen(str) + 1'))
+        elif a['type'] == 'binary':
+            args, len_, src = ['const void *data', 'size_t len'], 'len', \
+                'data'
+        else:
+            args, len_, src = [], '0', None
+
+        out += wrap_call('static inline int ', name,
+                         ['struct nlmsghdr *nlh', 'size_t size'] + args, '')
+        out.append('{')
+        if not src:
+            out += wrap_call('\treturn ', 'genltest_nla_reserve',
+                             ['nlh', 'size', enum, '0'], ' ? 0 : -EMSGSIZE;')
+            out += ['}', '']
+            continue
+
+        # The last one is p, declared with the call that it's set by
+        decls.append(('void', '*p', None))
+        names = 8 + max(len(t) + 1 + v.startswith('*') for t, v, _ in decls)
+        eq = names + max(len(v.lstrip('*')) for _, v, _ in decls) + 1
+        for t, v, init in decls:
+            line = pad_to(pad_to('\t' + t, names - v.startswith('*')) + v,
+                          eq) + '= '
+            if init:
+                out.append(line + init + ';')
+        out += wrap_call(line, 'genltest_nla_reserve',
+                         ['nlh', 'size', enum, len_], ';')
+        out += ['',
+                '\tif (!p) {', '\t\treturn -EMSGSIZE;', '\t}',
+                '\tmemcpy(p, %s, %s);' % (src, len_),
+                '',
+                '\treturn 0;',
+                '}', '']
+
+
+def wrap_call(head, fn, args, tail):
+    """head fn(args)tail, with the arguments wrapped if it's too long"""
+    line = head + fn + '(' + ', '.join(args) + ')' + tail
+    if col(line) <= 80:
+        return [line]
+    indent = pad_to('', col(head + fn + '('))
+    lines, cur = [], head + fn + '(' + args[0]
+    for i, arg in enumerate(args[1:], 2):
+        end = ')' + tail if i == len(args) else ','
+        if col(cur + ', ' + arg + end) > 80:
+            lines.append(cur + ',')
+            cur = indent + arg
+        else:
+            cur += ', ' + arg
+    return lines + [cur + ')' + tail]
+
+
+def gen_user(fam):
+    out = []
+    guard = fam.prefix + 'NL_USER_H'
+    fam.header(out, 'parsers and encoders for user space')
+    out += comment('Parsing and building of the messages of the family '
+                   'without libnl, or any other library. Parsers are a switch '
+                   'on the type of attribute, writing into fields at fixed '
+                   'offsets of a struct, instead of a table of attributes '
+                   'checked against a policy, and encoders write straight '
+                   'into the message. All of it works on plain buffers, and '
+                   'on libnl messages just as well, through nlmsg_hdr() and '
+                   'nlmsg_get_max_size().')
+    out += ['#ifndef ' + guard, '#define ' + guard, '',
+            '#include <errno.h>', '#include <stddef.h>', '#include <string.h>',
+            '#include <linux/genetlink.h>', '#include <linux/netlink.h>', '',
+            '#include "../ks/genltest.h"']
+    out += USER_HELPERS.split('\n')[:-1]
+    out.append('')
+
+    for s in fam.sets.values():
+        if 'subset-of' in s:
+            continue
+        gen_user_parser(out, fam, s)
+    gen_user_encoders(out, fam, fam.sets[fam.name])
+    gen_names(out, fam)
+
+    out += ['#endif /* %s */' % guard]
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--mode', choices=['uapi', 'kernel', 'user'],
+                        required=True)
+    parser.add_argument('spec')
+    args = parser.parse_args()
+
+    with open(args.spec) as f:
+        fam = Family(yaml.safe_load(f))
+
+    out = {'uapi': gen_uapi, 'kernel': gen_kernel, 'user': gen_user}[
+        args.mode](fam)
+    print('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()
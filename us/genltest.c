@@ -7,10 +7,25 @@
  *
  *  Copyright (c) 2022 Yaroslav de la Peña Smirnov <yps@yaroslavps.com>
  */
+#define _GNU_SOURCE /* recvmmsg(), pthread_setaffinity_np() */
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
 #include <signal.h>
+#include <sched.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/genetlink.h>
 #include <netlink/socket.h>
 #include <netlink/netlink.h>
 #include <netlink/genl/ctrl.h>
@@ -18,161 +33,2798 @@
 #include <netlink/genl/family.h>
 
 #include "../ks/genltest.h"
+#include "libgenltest.h"
+#include "genltest_nl_user.h"
 
 #define prerr(...) fprintf(stderr, "error: " __VA_ARGS__)
 
+/* What we send to GENLTEST_CMD_ECHO */
+#define ECHO_MSG "Hello from User Space, Netlink!"
+
+/* Room for each of the strings sent in a batch */
+#define BATCH_MSG_LEN 64
+
+/*
+ * Most strings in a batch. The nest that holds them has a 16 bit length, like
+ * any other attribute, and each of them takes up to this much of it.
+ */
+#define BATCH_MAX_COUNT                                                        \
+	((UINT16_MAX - NLA_HDRLEN) / NLA_ALIGN(NLA_HDRLEN + BATCH_MSG_LEN))
+
+/*
+ * Number and size of the buffers that rate mode receives datagrams into, as
+ * big as the receive buffer of the sockets of libgenltest.
+ */
+#define RING_SLOTS   64
+#define RING_BUF_LEN GENLTEST_MSG_BUF_LEN
+
+/* Empty passes over the shared rings before sleeping until there's more */
+#define RING_SPIN 100000
+
+/* Echoes in flight at the same time in the event loop if not told otherwise */
+#define PIPELINE_DEFAULT_DEPTH 64
+
+/* Echoes sent by each thread in parallel mode if not told otherwise */
+#define WORKER_DEFAULT_COUNT 10000
+
+/* Defaults of the bench subcommand */
+#define BENCH_DEFAULT_COUNT 100000
+#define BENCH_DEFAULT_SIZE  64
+
 /*
  * libnl docs and API: https://www.infradead.org/~tgr/libnl/
  * Current libnl repo: https://github.com/thom311/libnl
  */
 
+/*
+ * Print the counters inside of a GENLTEST_A_STATS nest, with the names from
+ * the spec of the family.
+ */
+static void print_stats(const struct nlattr *stats)
+{
+	const struct nlattr *nla;
+	uint64_t	     val;
+	int		     rem;
+
+	genltest_nla_for_each(nla, genltest_nla_data(stats),
+			      genltest_nla_len(stats), rem) {
+		unsigned int type = nla->nla_type & NLA_TYPE_MASK;
+
+		if (type > GENLTEST_STATS_A_MAX || !genltest_stats_names[type] ||
+		    genltest_nla_len(nla) < (int)sizeof(val)) {
+			continue;
+		}
+		memcpy(&val, genltest_nla_data(nla), sizeof(val));
+		printf("%s %llu\n", genltest_stats_names[type],
+		       (unsigned long long)val);
+	}
+}
+
+/*
+ * Print the histogram of a GENLTEST_A_LATENCY nest, in the same format as the
+ * latency file of the module in debugfs.
+ */
+static void print_latency(const struct nlattr *lat)
+{
+	struct genltest_latency_tb tb;
+	uint64_t		   bucket;
+	int			   i, n;
+
+	if (genltest_latency_parse(&tb, genltest_nla_data(lat),
+				   genltest_nla_len(lat)) ||
+	    !genltest_latency_has(&tb, GENLTEST_LATENCY_A_STAGE)) {
+		return;
+	}
+	printf("%s count %llu sum_ns %llu\n", tb.stage,
+	       (unsigned long long)tb.count, (unsigned long long)tb.sum);
+	if (!genltest_latency_has(&tb, GENLTEST_LATENCY_A_BUCKETS)) {
+		return;
+	}
+
+	/* Only 4 byte aligned, like any other attribute */
+	n = genltest_nla_len(tb.buckets) / sizeof(bucket);
+	for (i = 0; i < n; i++) {
+		memcpy(&bucket,
+		       (const char *)genltest_nla_data(tb.buckets) +
+			       i * sizeof(bucket),
+		       sizeof(bucket));
+		if (bucket) {
+			printf("  [%llu, %llu) %llu\n", i ? 1ULL << i : 0,
+			       1ULL << (i + 1), (unsigned long long)bucket);
+		}
+	}
+}
+
+/*
+ * Tracking of the sequence numbers of multicast notifications, to find out how
+ * many of them we missed because our socket overran. Each group has its own
+ * sequence numbers.
+ */
+struct mc_track {
+	/* The handle that they come in on, synced if the module is reloaded */
+	struct genltest	  *gt;
+	bool		   synced[__GENLTEST_MCGRP_MAX];
+	uint32_t	   next_seq[__GENLTEST_MCGRP_MAX];
+	unsigned long long lost;
+	unsigned long long overruns;
+};
+
+/*
+ * Account for a message to group carrying n notifications, the first one of
+ * them with sequence number seq. Returns the number of notifications that were
+ * lost right before this one.
+ */
+static uint32_t track_seq(struct mc_track *t, uint32_t group, uint32_t seq,
+			  unsigned int n)
+{
+	int32_t gap;
+
+	/* A group that the module knows about and we don't */
+	if (group > GENLTEST_MCGRP_MAX) {
+		return 0;
+	}
+
+	/*
+	 * A negative gap means that the module was reloaded (or that we got
+	 * something older), in which case we just start over from here.
+	 */
+	gap = seq - t->next_seq[group];
+	if (!t->synced[group] || gap < 0) {
+		gap = 0;
+	}
+	t->synced[group]   = true;
+	t->next_seq[group] = seq + n;
+	t->lost += gap;
+
+	return gap;
+}
+
+/* Multicast group of a notification, the default one if it doesn't say */
+static inline uint32_t mcgrp_of(const struct genltest_tb *tb)
+{
+	return genltest_has(tb, GENLTEST_A_MCGRP) ? tb->mcgrp :
+						    GENLTEST_MCGRP_DEFAULT;
+}
+
+/* Number of notifications carried by a message, nested or not */
+static unsigned int count_payloads_of(const struct genltest_tb *tb)
+{
+	const struct nlattr *nla;
+	unsigned int	     n = genltest_has(tb, GENLTEST_A_MSG) +
+			     genltest_has(tb, GENLTEST_A_DATA);
+	int		     rem;
+
+	if (!genltest_has(tb, GENLTEST_A_BATCH)) {
+		return n;
+	}
+	genltest_nla_for_each(nla, genltest_nla_data(tb->batch),
+			      genltest_nla_len(tb->batch), rem) {
+		n++;
+	}
+
+	return n;
+}
+
 /*
  * Handler for all received messages from our Generic Netlink family, both
- * unicast and multicast.
+ * unicast and multicast. arg is the mc_track of the socket, if it receives
+ * multicast notifications.
  */
 static int echo_reply_handler(struct nl_msg *msg, void *arg)
 {
-	int		   err	   = 0;
-	struct genlmsghdr *genlhdr = nlmsg_data(nlmsg_hdr(msg));
-	struct nlattr	  *tb[GENLTEST_A_MAX + 1];
+	struct nlmsghdr	    *nlh = nlmsg_hdr(msg);
+	struct genltest_tb   tb;
+	const struct nlattr *nla;
+	int		     rem;
 
-	/* Parse the attributes */
-	err = nla_parse(tb, GENLTEST_A_MAX, genlmsg_attrdata(genlhdr, 0),
-			genlmsg_attrlen(genlhdr, 0), NULL);
-	if (err) {
-		prerr("unable to parse message: %s\n", strerror(-err));
+	/* The multicast socket also gets the notifications of nlctrl */
+	if (nlh->nlmsg_type == GENL_ID_CTRL) {
+		if (genltest_ctrl_notify(nlh)) {
+			printf("family %s reloaded, cache dropped\n",
+			       GENLTEST_GENL_NAME);
+			/* Fails until the family is back, then joins again */
+			if (arg) {
+				genltest_sync(((struct mc_track *)arg)->gt);
+			}
+		}
+		return NL_OK;
+	}
+
+	/* Parse the attributes, with the parser generated from the spec */
+	if (genltest_parse(&tb, genltest_attrs(nlh), genltest_attrs_len(nlh))) {
+		prerr("unable to parse message\n");
 		return NL_SKIP;
 	}
+	/* Find out if we missed any notifications before this one */
+	if (arg && genltest_has(&tb, GENLTEST_A_SEQ)) {
+		uint32_t lost = track_seq(arg, mcgrp_of(&tb), tb.seq,
+					  count_payloads_of(&tb));
+		if (lost) {
+			prerr("lost %u notifications, %llu so far\n", lost,
+			      ((struct mc_track *)arg)->lost);
+		}
+	}
+	if (genltest_has(&tb, GENLTEST_A_STATS)) {
+		print_stats(tb.stats);
+		/* And a histogram for each stage, if latency_hist is on */
+		genltest_nla_for_each(nla, genltest_attrs(nlh),
+				      genltest_attrs_len(nlh), rem) {
+			if ((nla->nla_type & NLA_TYPE_MASK) ==
+			    GENLTEST_A_LATENCY) {
+				print_latency(nla);
+			}
+		}
+		return NL_OK;
+	}
+	/* One of the shared rings overflowed, to the urgent group */
+	if (((struct genlmsghdr *)nlmsg_data(nlh))->cmd == GENLTEST_CMD_RING &&
+	    genltest_has(&tb, GENLTEST_A_RING_DROPPED)) {
+		uint32_t ring = genltest_has(&tb, GENLTEST_A_RING_INDEX) ?
+					tb.ring_index :
+					0;
+
+		printf("ring %u overflowed, %llu dropped so far\n", ring,
+		       (unsigned long long)tb.ring_dropped);
+		return NL_OK;
+	}
+	/*
+	 * Replies to a batch carry all of the messages inside of a nest, which
+	 * the kernel has validated the entries of already when they came in.
+	 */
+	if (genltest_has(&tb, GENLTEST_A_BATCH)) {
+		genltest_nla_for_each(nla, genltest_nla_data(tb.batch),
+				      genltest_nla_len(tb.batch), rem) {
+			unsigned int type = nla->nla_type & NLA_TYPE_MASK;
+
+			if (type == GENLTEST_A_MSG) {
+				printf("message received: %.*s\n",
+				       genltest_nla_len(nla),
+				       (const char *)genltest_nla_data(nla));
+			} else if (type == GENLTEST_A_DATA) {
+				printf("data received: %d bytes\n",
+				       genltest_nla_len(nla));
+			}
+		}
+
+		return NL_OK;
+	}
+	/* Binary data isn't printable, just say how much of it came back */
+	if (genltest_has(&tb, GENLTEST_A_DATA)) {
+		printf("data received: %d bytes\n", genltest_nla_len(tb.data));
+		return NL_OK;
+	}
 	/* Check that there's actually a payload */
-	if (!tb[GENLTEST_A_MSG]) {
+	if (!genltest_has(&tb, GENLTEST_A_MSG)) {
 		prerr("msg attribute missing from message\n");
 		return NL_SKIP;
 	}
 
 	/* Print it! */
-	printf("message received: %s\n", nla_get_string(tb[GENLTEST_A_MSG]));
+	printf("message received: %s\n", tb.msg);
 
 	return NL_OK;
 }
 
-/* Send (unicast) GENLTEST_CMD_ECHO request message */
-static int send_echo_msg(struct nl_sock *sk, int fam)
+/*
+ * Send (unicast) GENLTEST_CMD_ECHO_BATCH request message with n messages that
+ * the kernel should echo back to us in a single reply. Batches of more than
+ * BATCH_MAX_COUNT don't fit in a nest, and are rejected with -NLE_MSGSIZE.
+ */
+static int send_echo_batch(struct nl_sock *sk, int fam, unsigned int n)
 {
 	int	       err = 0;
-	struct nl_msg *msg = nlmsg_alloc();
+	char	       str[BATCH_MSG_LEN];
+	struct nlattr *nest;
+	struct nl_msg *msg;
+
+	if (n > BATCH_MAX_COUNT) {
+		return -NLE_MSGSIZE;
+	}
+
+	/*
+	 * The default message buffer is only one page long, make sure that the
+	 * whole batch fits in. It can be much bigger than the messages of the
+	 * pool of libgenltest too, so it gets its own.
+	 */
+	msg = nlmsg_alloc_size(NLMSG_HDRLEN + GENL_HDRLEN + NLA_HDRLEN +
+			       n * NLA_ALIGN(NLA_HDRLEN + BATCH_MSG_LEN));
 	if (!msg) {
-		return -ENOMEM;
+		return -NLE_NOMEM;
 	}
 
 	/* Put the genl header inside message buffer */
 	void *hdr = genlmsg_put(msg, NL_AUTO_PORT, NL_AUTO_SEQ, fam, 0, 0,
-				GENLTEST_CMD_ECHO, GENLTEST_GENL_VERSION);
+				GENLTEST_CMD_ECHO_BATCH, GENLTEST_GENL_VERSION);
 	if (!hdr) {
-		return -EMSGSIZE;
+		err = -NLE_MSGSIZE;
+		goto out;
 	}
 
-	/* Put the string inside the message. */
-	err = nla_put_string(msg, GENLTEST_A_MSG,
-			     "Hello from User Space, Netlink!");
-	if (err < 0) {
-		return -err;
+	/*
+	 * Open the nest that will hold all of the strings. The kernel validates
+	 * nested attributes strictly, so the nested flag needs to be set.
+	 */
+	nest = nla_nest_start(msg, GENLTEST_A_BATCH | NLA_F_NESTED);
+	if (!nest) {
+		err = -NLE_MSGSIZE;
+		goto out;
+	}
+	for (unsigned int i = 0; i < n; i++) {
+		snprintf(str, sizeof(str), ECHO_MSG " #%u", i);
+		if (nla_put_string(msg, GENLTEST_A_MSG, str) < 0) {
+			err = -NLE_MSGSIZE;
+			goto out;
+		}
+	}
+	/* Fails if the nest outgrew its 16 bit length after all */
+	if (nla_nest_end(msg, nest) < 0) {
+		err = -NLE_MSGSIZE;
+		goto out;
 	}
-	printf("message sent\n");
+	printf("batch of %u messages sent\n", n);
 
 	/* Send the message. */
 	err = nl_send_auto(sk, msg);
 	err = err >= 0 ? 0 : err;
 
+out:
 	nlmsg_free(msg);
 
 	return err;
 }
 
-/* Allocate netlink socket and connect to generic netlink */
-static int conn(struct nl_sock **sk)
+/*
+ * Send GENLTEST_CMD_ECHO dump request message. Instead of a single reply, the
+ * kernel streams count records back to us in as many multipart messages as
+ * needed, finishing with NLMSG_DONE.
+ */
+static int send_echo_dump(struct genltest *gt, unsigned int count)
 {
-	*sk = nl_socket_alloc();
-	if (!sk) {
-		return -ENOMEM;
+	/* Put the genl header inside message buffer, with the dump flag */
+	struct nl_msg *msg = genltest_msg(gt, GENLTEST_CMD_ECHO, NLM_F_DUMP,
+					  NL_AUTO_SEQ);
+	if (!msg) {
+		return -NLE_NOMEM;
+	}
+
+	/* Tell the kernel how many records we want */
+	if (nla_put_u32(msg, GENLTEST_A_COUNT, count) < 0) {
+		genltest_msg_put(gt, msg);
+		return -NLE_MSGSIZE;
+	}
+	printf("dump of %u messages requested\n", count);
+
+	/* Send the message, which also gives it back to the pool. */
+	return genltest_send(gt, msg);
+}
+
+/* Send GENLTEST_CMD_GET_STATS request message */
+static int send_get_stats(struct genltest *gt)
+{
+	/* The command alone is enough, there are no attributes to put */
+	struct nl_msg *msg = genltest_msg(gt, GENLTEST_CMD_GET_STATS, 0,
+					  NL_AUTO_SEQ);
+	if (!msg) {
+		return -NLE_NOMEM;
+	}
+
+	return genltest_send(gt, msg);
+}
+
+/*
+ * Receive the reply to a request. libnl asks for an ACK for every request that
+ * it sends, so consume it too in order to not confuse it with the reply to the
+ * next request. If the request failed because the ids of the handle are stale,
+ * they are resolved again for the next one.
+ */
+static int recv_reply(struct genltest *gt)
+{
+	struct nl_sock *sk  = genltest_sock(gt);
+	int		err = nl_recvmsgs_default(sk);
+
+	if (err >= 0) {
+		err = nl_wait_for_ack(sk);
+	}
+	genltest_recover(gt, err);
+
+	return err;
+}
+
+/*
+ * Count the payloads inside of the datagram in buf without going through any of
+ * the libnl machinery, that is without allocating a nl_msg and without calling
+ * any callback, and keep track of their sequence numbers. Only messages from
+ * our family are taken into account.
+ */
+static unsigned int count_payloads(void *buf, int len, struct mc_track *t)
+{
+	unsigned int	 total = 0;
+	struct nlmsghdr *nlh;
+
+	for (nlh = buf; nlmsg_ok(nlh, len); nlh = nlmsg_next(nlh, &len)) {
+		struct genltest_tb tb;
+		unsigned int	   n;
+
+		if (nlh->nlmsg_type == GENL_ID_CTRL &&
+		    genltest_ctrl_notify(nlh)) {
+			genltest_sync(t->gt);
+		}
+		if (nlh->nlmsg_type != genltest_family(t->gt) ||
+		    genltest_parse(&tb, genltest_attrs(nlh),
+				   genltest_attrs_len(nlh))) {
+			continue;
+		}
+		n = count_payloads_of(&tb);
+		if (genltest_has(&tb, GENLTEST_A_SEQ)) {
+			track_seq(t, mcgrp_of(&tb), tb.seq, n);
+		}
+		total += n;
+	}
+
+	return total;
+}
+
+/*
+ * High rate receive mode. Instead of going through nl_recvmsgs() for each
+ * datagram, drain the socket with recvmmsg() into a ring of preallocated
+ * buffers, count what was received in place and print a summary once per
+ * second instead of printing each message.
+ */
+static int recv_rate(struct mc_track *t)
+{
+	static char	bufs[RING_SLOTS][RING_BUF_LEN];
+	struct mmsghdr	msgs[RING_SLOTS];
+	struct iovec	iovs[RING_SLOTS];
+	struct timespec last, now;
+	unsigned long long npayloads = 0, ndgrams = 0, nbytes = 0, ntrunc = 0,
+			   lost = t->lost, overruns = t->overruns;
+	int		   fd = nl_socket_get_fd(genltest_sock(t->gt));
+	/* Wake up at least once per second even if nothing arrives */
+	struct timeval timeout = { .tv_sec = 1 };
+
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+		       sizeof(timeout))) {
+		return -errno;
+	}
+
+	memset(msgs, 0, sizeof(msgs));
+	for (int i = 0; i < RING_SLOTS; i++) {
+		iovs[i].iov_base	   = bufs[i];
+		iovs[i].iov_len		   = RING_BUF_LEN;
+		msgs[i].msg_hdr.msg_iov	   = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	printf("receiving in rate mode\n");
+	clock_gettime(CLOCK_MONOTONIC, &last);
+	while (1) {
+		/* Block until there's at least one, then take all we can */
+		int n = recvmmsg(fd, msgs, RING_SLOTS, MSG_WAITFORONE, NULL);
+		if (n < 0) {
+			if (errno == ENOBUFS) {
+				/* We fell behind and the kernel dropped some */
+				t->overruns++;
+			} else if (errno != EAGAIN && errno != EINTR) {
+				return -errno;
+			}
+			n = 0;
+		}
+
+		for (int i = 0; i < n; i++) {
+			if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+				ntrunc++;
+				continue;
+			}
+			npayloads += count_payloads(bufs[i], msgs[i].msg_len,
+						    t);
+			nbytes += msgs[i].msg_len;
+		}
+		ndgrams += n;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		double elapsed = (now.tv_sec - last.tv_sec) +
+				 (now.tv_nsec - last.tv_nsec) / 1e9;
+		if (elapsed < 1.0) {
+			continue;
+		}
+
+		printf("%.0f msg/s %.0f dgram/s %.2f MB/s, %llu truncated, "
+		       "%llu overruns, %llu lost (%llu total)\n",
+		       npayloads / elapsed, ndgrams / elapsed,
+		       nbytes / elapsed / 1e6, ntrunc, t->overruns - overruns,
+		       t->lost - lost, t->lost);
+		fflush(stdout);
+		npayloads = ndgrams = nbytes = ntrunc = 0;
+		lost	  = t->lost;
+		overruns  = t->overruns;
+		last	  = now;
+	}
+
+	return 0;
+}
+
+/*
+ * Set the size of the receive buffer of the socket. Try to go over rmem_max
+ * first, which is only allowed with CAP_NET_ADMIN.
+ */
+static int set_rcvbuf(struct nl_sock *sk, int size)
+{
+	int fd = nl_socket_get_fd(sk);
+
+	if (!setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size))) {
+		return 0;
+	}
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size))) {
+		return -errno;
 	}
 
-	return genl_connect(*sk);
+	return 0;
 }
 
-/* Disconnect and release socket */
-static void disconn(struct nl_sock *sk)
+/*
+ * Don't report ENOBUFS when the socket overruns. Lost notifications can still
+ * be told apart by their sequence numbers.
+ */
+static int set_no_enobufs(struct nl_sock *sk)
 {
-	nl_close(sk);
-	nl_socket_free(sk);
+	int one = 1;
+
+	if (setsockopt(nl_socket_get_fd(sk), SOL_NETLINK, NETLINK_NO_ENOBUFS,
+		       &one, sizeof(one))) {
+		return -errno;
+	}
+
+	return 0;
 }
 
 /* Modify the callback for replies to handle all received messages */
-static inline int set_cb(struct nl_sock *sk)
+static inline int set_cb(struct nl_sock *sk, void *arg)
 {
 	return nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-				   echo_reply_handler, NULL);
+				   echo_reply_handler, arg);
 }
 
-int main(void)
+/* State of each of the threads sending echoes in parallel */
+struct worker {
+	pthread_t	   tid;
+	int		   cpu;
+	unsigned int	   count;
+	uint32_t	   portid;
+	unsigned long long replies;
+	unsigned long long failed;
+	double		   elapsed;
+};
+
+/* Handler for the replies received by the workers, which just counts them */
+static int count_handler(struct nl_msg *msg, void *arg)
 {
-	int		ret = 1;
-	struct nl_sock *ucsk, *mcsk;
+	(*(unsigned long long *)arg)++;
 
-	/*
-	 * We use one socket to receive asynchronous "notifications" over
-	 * multicast group, and another for ops. We do this so that we don't mix
-	 * up responses from ops with notifications to make handling easier.
-	 */
-	if ((ret = conn(&ucsk)) || (ret = conn(&mcsk))) {
-		prerr("failed to connect to generic netlink\n");
-		goto out;
-	}
+	return NL_OK;
+}
 
-	/* Resolve the genl family. One family for both unicast and multicast. */
-	int fam = genl_ctrl_resolve(ucsk, GENLTEST_GENL_NAME);
-	if (fam < 0) {
-		prerr("failed to resolve generic netlink family: %s\n",
-		      strerror(-fam));
-		goto out;
+/* Pin the calling thread to cpu */
+static void pin_cpu(int cpu)
+{
+	cpu_set_t cpus;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+}
+
+/*
+ * Pin the calling thread to cpu, like pin_cpu(), and return the NUMA node that
+ * it's on, or a negative errno.
+ */
+static int pin_node(int cpu)
+{
+	unsigned int cur, node;
+	cpu_set_t    cpus;
+	int	     err;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	if ((err = pthread_setaffinity_np(pthread_self(), sizeof(cpus),
+					  &cpus))) {
+		return -err;
+	}
+	/* We can only run on cpu from now on, so its node is ours */
+	if (syscall(SYS_getcpu, &cur, &node, NULL)) {
+		return -errno;
 	}
 
-	/* Disable sequence checks for asynchronous multicast messages. */
-	nl_socket_disable_seq_check(mcsk);
+	return node;
+}
 
-	/* Resolve the multicast group. */
-	int mcgrp = genl_ctrl_resolve_grp(mcsk, GENLTEST_GENL_NAME,
-					  GENLTEST_MC_GRP_NAME);
-	if (mcgrp < 0) {
-		prerr("failed to resolve generic netlink multicast group: %s\n",
-		      strerror(-mcgrp));
-		goto out;
+/*
+ * Each worker has a handle of its own, and so a portid of its own, and runs
+ * pinned to its own CPU. All of them share the family id resolved by main(),
+ * libgenltest only resolves it once, and again for all of them if they find
+ * out that it's stale.
+ */
+static void *echo_worker(void *arg)
+{
+	struct worker	*w = arg;
+	struct genltest *gt;
+	struct nl_sock	*sk;
+	struct timespec	 start, end;
+
+	pin_cpu(w->cpu);
+
+	if (genltest_open(&gt)) {
+		w->failed = w->count;
+		return NULL;
 	}
-	/* Join the multicast group. */
-	if ((ret = nl_socket_add_membership(mcsk, mcgrp) < 0)) {
-		prerr("failed to join multicast group: %s\n", strerror(-ret));
-		goto out;
+	sk = genltest_sock(gt);
+	if (nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM, count_handler,
+				&w->replies)) {
+		w->failed = w->count;
+		genltest_close(gt);
+		return NULL;
 	}
+	w->portid = nl_socket_get_local_port(sk);
 
-	if ((ret = set_cb(ucsk)) || (ret = set_cb(mcsk))) {
-		prerr("failed to set callback: %s\n", strerror(-ret));
-		goto out;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (unsigned int i = 0; i < w->count; i++) {
+		if (genltest_echo(gt, ECHO_MSG, NL_AUTO_SEQ) ||
+		    recv_reply(gt) < 0) {
+			w->failed++;
+		}
 	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	w->elapsed = (end.tv_sec - start.tv_sec) +
+		     (end.tv_nsec - start.tv_nsec) / 1e9;
 
-	/* Send unicast message and listen for response. */
-	if ((ret = send_echo_msg(ucsk, fam))) {
-		prerr("failed to send message: %s\n", strerror(-ret));
+	genltest_close(gt);
+
+	return NULL;
+}
+
+/* Send count echoes from each of jobs threads at the same time */
+static int run_workers(unsigned int jobs, unsigned int count)
+{
+	int		   ret	   = 0;
+	long		   ncpus   = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned long long replies = 0;
+	double		   elapsed = 0;
+	struct worker	  *workers = calloc(jobs, sizeof(*workers));
+	if (!workers) {
+		return -ENOMEM;
 	}
-	printf("listening for messages\n");
-	nl_recvmsgs_default(ucsk);
 
-	/* Listen for "notifications". */
-	while (1) {
-		nl_recvmsgs_default(mcsk);
+	for (unsigned int i = 0; i < jobs; i++) {
+		workers[i].cpu	 = i % ncpus;
+		workers[i].count = count;
+		if ((ret = pthread_create(&workers[i].tid, NULL, echo_worker,
+					  &workers[i]))) {
+			jobs = i;
+			ret  = -ret;
+			break;
+		}
 	}
 
-	ret = 0;
-out:
-	disconn(ucsk);
-	disconn(mcsk);
+	for (unsigned int i = 0; i < jobs; i++) {
+		struct worker *w = &workers[i];
+
+		pthread_join(w->tid, NULL);
+		printf("thread %u: cpu %d, portid %u, %llu replies, %llu "
+		       "failed, %.0f echo/s\n",
+		       i, w->cpu, w->portid, w->replies, w->failed,
+		       w->elapsed > 0 ? w->replies / w->elapsed : 0);
+		replies += w->replies;
+		elapsed = w->elapsed > elapsed ? w->elapsed : elapsed;
+	}
+	if (elapsed > 0) {
+		printf("total: %llu replies, %.0f echo/s\n", replies,
+		       replies / elapsed);
+	}
+
+	free(workers);
+
 	return ret;
 }
+
+/* Current time in nanoseconds, not subject to NTP adjustments */
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Echoes pipelined by the event loop. Up to depth of them are in flight at the
+ * same time, each one in the slot of its sequence number modulo depth, which
+ * is how replies are matched to them. A slot is only reused once the echo in
+ * it is done, so the window never runs ahead of the oldest echo by more than
+ * depth.
+ */
+struct pipeline {
+	struct genltest	  *gt;
+	/* What to echo, a string or size bytes of binary data */
+	const char	  *payload;
+	size_t		   size;
+	bool		   str;
+	/* Where to put the RTT of each echo done, if anywhere */
+	uint64_t	  *rtts;
+	unsigned int	   count;
+	unsigned int	   depth;
+	unsigned int	   sent;
+	unsigned int	   done;
+	unsigned int	   failed;
+	unsigned int	   inflight;
+	unsigned int	   max_inflight;
+	uint32_t	   next_seq;
+	uint64_t	   start;
+	uint64_t	   rtt_sum;
+	uint64_t	   rtt_max;
+	struct pipe_slot {
+		bool	 busy;
+		uint32_t seq;
+		uint64_t t0;
+	}		  *slots;
+};
+
+/* Slot of the echo that seq belongs to, NULL if it's not one of ours */
+static struct pipe_slot *pipeline_slot(struct pipeline *p, uint32_t seq)
+{
+	struct pipe_slot *s = &p->slots[seq % p->depth];
+
+	return s->busy && s->seq == seq ? s : NULL;
+}
+
+static void pipeline_complete(struct pipeline *p, struct pipe_slot *s,
+			      bool ok)
+{
+	uint64_t rtt = now_ns() - s->t0;
+
+	s->busy = false;
+	p->inflight--;
+	if (!ok) {
+		p->failed++;
+		return;
+	}
+	if (p->rtts) {
+		p->rtts[p->done] = rtt;
+	}
+	p->done++;
+	p->rtt_sum += rtt;
+	p->rtt_max = rtt > p->rtt_max ? rtt : p->rtt_max;
+}
+
+static int pipeline_reply_handler(struct nl_msg *msg, void *arg)
+{
+	struct pipe_slot *s = pipeline_slot(arg, nlmsg_hdr(msg)->nlmsg_seq);
+
+	if (s) {
+		pipeline_complete(arg, s, true);
+	}
+
+	return NL_OK;
+}
+
+static int pipeline_err_handler(struct sockaddr_nl *nla, struct nlmsgerr *err,
+				void *arg)
+{
+	struct pipeline	 *p   = arg;
+	struct pipe_slot *s   = pipeline_slot(p, err->msg.nlmsg_seq);
+	const char	 *why = genltest_ext_ack_msg(err);
+
+	if (why) {
+		prerr("echo %u failed: %s\n", err->msg.nlmsg_seq, why);
+	}
+	/* The echoes sent from now on go to the family as it is now */
+	genltest_recover(p->gt, -nl_syserr2nlerr(err->error));
+	if (s) {
+		pipeline_complete(arg, s, false);
+	}
+
+	return NL_SKIP;
+}
+
+/*
+ * ACKs only complete echoes that got no reply, which can't really happen with
+ * replies and ACKs coming in order, but doesn't cost anything either.
+ */
+static int pipeline_ack_handler(struct nl_msg *msg, void *arg)
+{
+	struct pipe_slot *s = pipeline_slot(arg, nlmsg_hdr(msg)->nlmsg_seq);
+
+	if (s) {
+		pipeline_complete(arg, s, true);
+	}
+
+	return NL_OK;
+}
+
+/*
+ * Receive replies out of order, matching them by sequence number instead of
+ * letting libnl expect them one after the other. Errors complete the echo
+ * they belong to as failed, and ACKs, if asked for, are taken in stride. The
+ * payload is ECHO_MSG until told otherwise.
+ */
+static int pipeline_init(struct pipeline *p, struct genltest *gt,
+			 unsigned int count, unsigned int depth)
+{
+	struct nl_sock *sk = genltest_sock(gt);
+
+	*p = (struct pipeline){
+		.gt	  = gt,
+		.payload  = ECHO_MSG,
+		.str	  = true,
+		.count	  = count,
+		.depth	  = depth,
+		.next_seq = nl_socket_use_seq(sk),
+		.slots	  = calloc(depth, sizeof(*p->slots)),
+	};
+	if (!p->slots) {
+		return -ENOMEM;
+	}
+
+	nl_socket_disable_seq_check(sk);
+	nl_socket_disable_auto_ack(sk);
+	if (nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
+				pipeline_reply_handler, p) ||
+	    nl_socket_modify_cb(sk, NL_CB_ACK, NL_CB_CUSTOM,
+				pipeline_ack_handler, p) ||
+	    nl_socket_modify_err_cb(sk, NL_CB_CUSTOM, pipeline_err_handler,
+				    p)) {
+		free(p->slots);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/* Send echoes until the window is full or there are no more to send */
+static int pipeline_fill(struct pipeline *p)
+{
+	if (!p->start) {
+		p->start = now_ns();
+	}
+
+	while (p->sent < p->count) {
+		struct pipe_slot *s = &p->slots[p->next_seq % p->depth];
+		int		  err;
+
+		if (s->busy) {
+			break;
+		}
+		s->t0 = now_ns();
+		err   = p->str ? genltest_echo(p->gt, p->payload, p->next_seq) :
+				 genltest_echo_data(p->gt, p->payload, p->size,
+						    p->next_seq);
+		if (err) {
+			/* The socket is full, more room once replies arrive */
+			if (err == -NLE_AGAIN && p->inflight) {
+				break;
+			}
+			return err;
+		}
+		s->busy = true;
+		s->seq	= p->next_seq++;
+		p->sent++;
+		p->inflight++;
+		p->max_inflight = p->inflight > p->max_inflight ?
+					  p->inflight :
+					  p->max_inflight;
+	}
+
+	return 0;
+}
+
+static void pipeline_report(struct pipeline *p)
+{
+	double elapsed = (now_ns() - p->start) / 1e9;
+
+	printf("%u echoes in %.3f s, %u failed, %.0f msg/s, %u in flight at "
+	       "most\n"
+	       "rtt avg %.1f us, max %.1f us\n",
+	       p->done, elapsed, p->failed,
+	       elapsed > 0 ? p->done / elapsed : 0, p->max_inflight,
+	       p->done ? p->rtt_sum / 1e3 / p->done : 0, p->rtt_max / 1e3);
+}
+
+/* State of each of the threads of the bench subcommand */
+struct bench_worker {
+	pthread_t	   tid;
+	int		   cpu;
+	unsigned int	   count;
+	unsigned int	   window;
+	/* Bulk mode, with an ACK every ack_every echoes, none if 0 */
+	bool		   bulk;
+	unsigned int	   ack_every;
+	const char	  *payload;
+	size_t		   size;
+	bool		   str;
+	uint64_t	  *rtts;
+	unsigned int	   done;
+	unsigned long long failed;
+	unsigned long long replies;
+	uint64_t	   start;
+	uint64_t	   end;
+};
+
+/*
+ * Keep up to w->window echoes in flight, so that the round trip time is hidden
+ * and what's measured is what the module can sustain. The RTT of each echo
+ * then includes the time it spent queued behind the others.
+ */
+static void bench_pipelined(struct bench_worker *w, struct genltest *gt)
+{
+	struct pipeline p;
+	struct nl_sock *sk = genltest_sock(gt);
+	struct nl_cb   *cb;
+
+	if (pipeline_init(&p, gt, w->count, w->window)) {
+		w->failed = w->count;
+		return;
+	}
+	p.payload = w->payload;
+	p.size	  = w->size;
+	p.str	  = w->str;
+	p.rtts	  = w->rtts;
+
+	cb	 = nl_socket_get_cb(sk);
+	w->start = now_ns();
+	while (p.done + p.failed < p.count) {
+		if (pipeline_fill(&p) || nl_recvmsgs_report(sk, cb) < 0) {
+			break;
+		}
+	}
+	w->end = now_ns();
+	nl_cb_put(cb);
+
+	/* Whatever didn't make it, including the ones never sent, failed */
+	w->done	  = p.done;
+	w->failed = p.count - p.done;
+	free(p.slots);
+}
+
+/*
+ * State of a bench_bulk() run. The echoes are sent with consecutive sequence
+ * numbers from seq0, so that errors and ACKs tell which one they are about.
+ */
+struct bulk {
+	struct bench_worker *w;
+	struct genltest	    *gt;
+	uint32_t	     seq0;
+	unsigned int	     acked;
+};
+
+/* Echoes that failed are marked as such in place of their RTT */
+#define BULK_FAILED UINT64_MAX
+
+/*
+ * An ACK is for all of the echoes up to it, the ones that failed already got
+ * their error before it.
+ */
+static int bulk_ack_handler(struct nl_msg *msg, void *arg)
+{
+	struct bulk *b	 = arg;
+	uint64_t     now = now_ns();
+	unsigned int end = nlmsg_hdr(msg)->nlmsg_seq - b->seq0 + 1;
+
+	if (end > b->w->count) {
+		return NL_OK;
+	}
+	for (; b->acked < end; b->acked++) {
+		uint64_t *rtt = &b->w->rtts[b->acked];
+
+		*rtt = *rtt == BULK_FAILED ? BULK_FAILED : now - *rtt;
+	}
+
+	return NL_STOP;
+}
+
+static int bulk_err_handler(struct sockaddr_nl *nla, struct nlmsgerr *err,
+			    void *arg)
+{
+	struct bulk *b	 = arg;
+	unsigned int idx = err->msg.nlmsg_seq - b->seq0;
+	const char  *why = genltest_ext_ack_msg(err);
+
+	if (idx >= b->w->count) {
+		return NL_SKIP;
+	}
+	prerr("echo #%u failed: %s%s%s\n", idx, strerror(-err->error),
+	      why ? ": " : "", why ? why : "");
+	b->w->rtts[idx] = BULK_FAILED;
+	genltest_recover(b->gt, -nl_syserr2nlerr(err->error));
+
+	return NL_SKIP;
+}
+
+/* Send one echo of the bulk, with GENLTEST_A_NOREPLY and maybe NLM_F_ACK */
+static int bulk_send(struct bench_worker *w, struct genltest *gt, uint32_t seq,
+		     bool ack)
+{
+	struct nlmsghdr *nlh;
+	size_t		 size;
+	struct nl_msg	*msg = genltest_msg(gt, GENLTEST_CMD_ECHO,
+					    ack ? NLM_F_ACK : 0, seq);
+	if (!msg) {
+		return -NLE_NOMEM;
+	}
+
+	nlh  = nlmsg_hdr(msg);
+	size = nlmsg_get_max_size(msg);
+	if ((w->str ? genltest_put_msg(nlh, size, w->payload) :
+		      genltest_put_data(nlh, size, w->payload, w->size)) ||
+	    genltest_put_noreply(nlh, size)) {
+		genltest_msg_put(gt, msg);
+		return -NLE_MSGSIZE;
+	}
+
+	return genltest_send(gt, msg);
+}
+
+/*
+ * Send echoes that the kernel doesn't reply to, only telling about the ones
+ * that fail, with an error that says which one it was and why. Errors are
+ * queued before the send returns, since the kernel handles requests right
+ * away, so an ACK every w->ack_every echoes is enough to know for sure how
+ * all of the ones before it went, and to not run ahead of the kernel. Then
+ * the RTT of each echo is how long it took to know. Without ACKs it's fire
+ * and forget, only the errors are collected at the end, and the RTT is how
+ * long sending took.
+ */
+static void bench_bulk(struct bench_worker *w, struct genltest *gt)
+{
+	struct nl_sock *sk = genltest_sock(gt);
+	struct bulk	b;
+	struct nl_cb   *cb;
+	unsigned int	sent;
+
+	b = (struct bulk){ .w = w, .gt = gt, .seq0 = nl_socket_use_seq(sk) };
+	nl_socket_disable_seq_check(sk);
+	if (nl_socket_modify_cb(sk, NL_CB_ACK, NL_CB_CUSTOM, bulk_ack_handler,
+				&b) ||
+	    nl_socket_modify_err_cb(sk, NL_CB_CUSTOM, bulk_err_handler, &b)) {
+		w->failed = w->count;
+		return;
+	}
+
+	cb	 = nl_socket_get_cb(sk);
+	w->start = now_ns();
+	for (sent = 0; sent < w->count; sent++) {
+		bool ack = w->ack_every && ((sent + 1) % w->ack_every == 0 ||
+					    sent + 1 == w->count);
+
+		w->rtts[sent] = now_ns();
+		if (bulk_send(w, gt, b.seq0 + sent, ack)) {
+			break;
+		}
+		if (!w->ack_every) {
+			w->rtts[sent] = now_ns() - w->rtts[sent];
+		}
+		while (ack && b.acked <= sent) {
+			if (nl_recvmsgs_report(sk, cb) < 0) {
+				goto out;
+			}
+		}
+	}
+	/* No ACKs, but the errors are in the socket already */
+	if (!w->ack_every && !nl_socket_set_nonblocking(sk)) {
+		while (nl_recvmsgs_report(sk, cb) > 0) {
+		}
+	}
+	b.acked = w->ack_every ? b.acked : sent;
+
+out:
+	w->end = now_ns();
+	nl_cb_put(cb);
+
+	/* Only the echoes known to be done count, without holes */
+	for (unsigned int i = 0; i < b.acked; i++) {
+		if (w->rtts[i] != BULK_FAILED) {
+			w->rtts[w->done++] = w->rtts[i];
+		}
+	}
+	w->failed = w->count - w->done;
+}
+
+/*
+ * Send echoes one after the other and record how long it takes for the reply
+ * to each of them to come back. The ACKs are turned off, so that only the
+ * reply itself is waited for. With a window, they are pipelined instead.
+ */
+static void *bench_worker(void *arg)
+{
+	struct bench_worker *w = arg;
+	struct genltest	    *gt;
+	struct nl_sock	    *sk;
+
+	pin_cpu(w->cpu);
+
+	if (genltest_open(&gt)) {
+		w->failed = w->count;
+		return NULL;
+	}
+	sk = genltest_sock(gt);
+	if (nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM, count_handler,
+				&w->replies)) {
+		w->failed = w->count;
+		genltest_close(gt);
+		return NULL;
+	}
+	nl_socket_disable_auto_ack(sk);
+
+	if (w->bulk) {
+		bench_bulk(w, gt);
+		genltest_close(gt);
+		return NULL;
+	}
+	if (w->window > 1) {
+		bench_pipelined(w, gt);
+		genltest_close(gt);
+		return NULL;
+	}
+
+	w->start = now_ns();
+	for (unsigned int i = 0; i < w->count; i++) {
+		uint64_t t0  = now_ns();
+		int	 err = w->str ?
+				   genltest_echo(gt, w->payload, NL_AUTO_SEQ) :
+				   genltest_echo_data(gt, w->payload, w->size,
+						      NL_AUTO_SEQ);
+
+		if (err || (err = nl_recvmsgs_default(sk)) < 0) {
+			genltest_recover(gt, err);
+			w->failed++;
+			continue;
+		}
+		w->rtts[w->done++] = now_ns() - t0;
+	}
+	w->end = now_ns();
+
+	genltest_close(gt);
+
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Nearest-rank percentile p (0 to 1) of the n sorted values in v, in us */
+static double percentile(const uint64_t *v, size_t n, double p)
+{
+	double rank = p * n;
+	size_t i    = rank;
+
+	if (!n) {
+		return 0;
+	}
+	/* The rank is ceil(p * n), counting from 1 */
+	if (i == rank && i > 0) {
+		i--;
+	}
+	i = i >= n ? n - 1 : i;
+
+	return v[i] / 1e3;
+}
+
+enum bench_fmt {
+	BENCH_FMT_TEXT,
+	BENCH_FMT_CSV,
+	BENCH_FMT_JSON,
+};
+
+static void bench_usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s bench [-n count] [-s size] [-c threads] [-w window] "
+		"[-a every] [-m] [-o text|csv|json]\n"
+		"  -n count    echoes sent in total (default %u)\n"
+		"  -s size     bytes of payload of each echo (default %u, "
+		"at most %u)\n"
+		"  -m          send the payload as a string instead of binary "
+		"data\n"
+		"  -c threads  threads sending echoes at the same time "
+		"(default 1)\n"
+		"  -w window   echoes in flight at the same time on each "
+		"thread (default 1)\n"
+		"  -a every    bulk mode, no replies and an ACK every this many "
+		"echoes,\n"
+		"              0 for none at all, only errors\n"
+		"  -o format   output format (default text)\n",
+		prog, BENCH_DEFAULT_COUNT, BENCH_DEFAULT_SIZE,
+		GENLTEST_DATA_MAX_LEN);
+}
+
+/*
+ * bench subcommand: measure the round trip time of echoes and how many of them
+ * the module can take per second.
+ */
+static int bench_main(const char *prog, int argc, char *argv[])
+{
+	int		     ret = 1, opt;
+	unsigned int	     count = BENCH_DEFAULT_COUNT, jobs = 1, window = 1;
+	unsigned int	     ack_every = 0;
+	size_t		     size = BENCH_DEFAULT_SIZE, n = 0;
+	enum bench_fmt	     fmt = BENCH_FMT_TEXT;
+	bool		     str = false, bulk = false;
+	long		     ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	char		    *payload = NULL;
+	uint64_t	    *rtts = NULL, start = UINT64_MAX, end = 0;
+	unsigned long long   failed = 0;
+	struct bench_worker *workers = NULL;
+	struct genltest	    *gt;
+
+	while ((opt = getopt(argc, argv, "n:s:c:w:a:mo:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			jobs = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			window = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			bulk	  = true;
+			ack_every = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			str = true;
+			break;
+		case 'o':
+			if (!strcmp(optarg, "text")) {
+				fmt = BENCH_FMT_TEXT;
+			} else if (!strcmp(optarg, "csv")) {
+				fmt = BENCH_FMT_CSV;
+			} else if (!strcmp(optarg, "json")) {
+				fmt = BENCH_FMT_JSON;
+			} else {
+				bench_usage(prog);
+				return 1;
+			}
+			break;
+		default:
+			bench_usage(prog);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (!jobs || !count || !window || size > GENLTEST_DATA_MAX_LEN) {
+		bench_usage(prog);
+		return 1;
+	}
+
+	/*
+	 * Resolve the family once for all of the threads, the handles that
+	 * they open reuse it.
+	 */
+	if ((ret = genltest_open(&gt))) {
+		prerr("failed to open generic netlink family: %s\n",
+		      nl_geterror(ret));
+		return 1;
+	}
+	genltest_close(gt);
+
+	/*
+	 * The payload is size bytes of either binary data, which the kernel
+	 * echoes back, or a string, which gets a fixed reply. The NUL is only
+	 * sent in the latter case.
+	 */
+	payload = malloc(size + 1);
+	rtts	= calloc(count, sizeof(*rtts));
+	workers = calloc(jobs, sizeof(*workers));
+	if (!payload || !rtts || !workers) {
+		prerr("out of memory\n");
+		goto out;
+	}
+	memset(payload, 'x', size);
+	payload[size] = '\0';
+
+	/* Split the echoes evenly between the threads */
+	for (unsigned int i = 0, off = 0; i < jobs; i++) {
+		struct bench_worker *w = &workers[i];
+
+		w->cpu	     = i % ncpus;
+		w->count     = count / jobs + (i < count % jobs);
+		w->payload   = payload;
+		w->size	     = size;
+		w->str	     = str;
+		w->window    = window;
+		w->bulk	     = bulk;
+		w->ack_every = ack_every;
+		w->rtts	     = rtts + off;
+		off += w->count;
+		if ((ret = pthread_create(&w->tid, NULL, bench_worker, w))) {
+			prerr("failed to create thread: %s\n", strerror(ret));
+			jobs = i;
+			break;
+		}
+	}
+
+	/* Gather the results in one place, without holes */
+	for (unsigned int i = 0; i < jobs; i++) {
+		struct bench_worker *w = &workers[i];
+
+		pthread_join(w->tid, NULL);
+		memmove(rtts + n, w->rtts, w->done * sizeof(*rtts));
+		n += w->done;
+		failed += w->failed;
+		start = w->start < start ? w->start : start;
+		end   = w->end > end ? w->end : end;
+	}
+	qsort(rtts, n, sizeof(*rtts), cmp_u64);
+
+	double elapsed = end > start ? (end - start) / 1e9 : 0;
+	double rate    = elapsed > 0 ? n / elapsed : 0;
+	double mbps    = rate * size / 1e6;
+	double p50 = percentile(rtts, n, 0.5), p99 = percentile(rtts, n, 0.99),
+	       p999 = percentile(rtts, n, 0.999),
+	       max  = percentile(rtts, n, 1);
+
+	switch (fmt) {
+	case BENCH_FMT_TEXT:
+		printf("%zu echoes of %zu bytes from %u threads (window %u) in "
+		       "%.3f s, %llu failed\n"
+		       "%.0f msg/s, %.2f MB/s\n"
+		       "rtt p50 %.1f us, p99 %.1f us, p99.9 %.1f us, "
+		       "max %.1f us\n",
+		       n, size, jobs, window, elapsed, failed, rate, mbps, p50,
+		       p99, p999, max);
+		break;
+	case BENCH_FMT_CSV:
+		printf("count,size,threads,window,elapsed_s,failed,msg_per_s,"
+		       "mb_per_s,p50_us,p99_us,p999_us,max_us\n"
+		       "%zu,%zu,%u,%u,%.6f,%llu,%.1f,%.3f,%.1f,%.1f,%.1f,"
+		       "%.1f\n",
+		       n, size, jobs, window, elapsed, failed, rate, mbps, p50,
+		       p99, p999, max);
+		break;
+	case BENCH_FMT_JSON:
+		printf("{\"count\": %zu, \"size\": %zu, \"threads\": %u, "
+		       "\"window\": %u, \"elapsed_s\": %.6f, \"failed\": %llu, "
+		       "\"msg_per_s\": %.1f, \"mb_per_s\": %.3f, "
+		       "\"p50_us\": %.1f, \"p99_us\": %.1f, "
+		       "\"p999_us\": %.1f, \"max_us\": %.1f}\n",
+		       n, size, jobs, window, elapsed, failed, rate, mbps, p50,
+		       p99, p999, max);
+		break;
+	}
+	ret = failed ? 1 : 0;
+
+out:
+	free(payload);
+	free(rtts);
+	free(workers);
+	return ret;
+}
+
+/* Names of the multicast groups, which are also the bits of the ring groups */
+static const char *const mcgrp_names[__GENLTEST_MCGRP_MAX] = {
+	[GENLTEST_MCGRP_DEFAULT] = GENLTEST_MC_GRP_NAME,
+	[GENLTEST_MCGRP_URGENT]	 = GENLTEST_MC_GRP_URGENT_NAME,
+	[GENLTEST_MCGRP_BULK]	 = GENLTEST_MC_GRP_BULK_NAME,
+	[GENLTEST_MCGRP_NODE0]	 = GENLTEST_MC_GRP_NODE0_NAME,
+	[GENLTEST_MCGRP_NODE1]	 = GENLTEST_MC_GRP_NODE1_NAME,
+	[GENLTEST_MCGRP_NODE2]	 = GENLTEST_MC_GRP_NODE2_NAME,
+	[GENLTEST_MCGRP_NODE3]	 = GENLTEST_MC_GRP_NODE3_NAME,
+};
+
+/* What the module told us about its shared rings */
+struct ring_info {
+	uint32_t size;
+	uint32_t count;
+	uint64_t dropped;
+};
+
+/* Handler for the reply to GENLTEST_CMD_RING, parsed like the others */
+static int ring_info_handler(struct nl_msg *msg, void *arg)
+{
+	struct ring_info  *info = arg;
+	struct nlmsghdr	  *nlh	= nlmsg_hdr(msg);
+	struct genltest_tb tb;
+
+	if (genltest_parse(&tb, genltest_attrs(nlh), genltest_attrs_len(nlh)) ||
+	    !genltest_has(&tb, GENLTEST_A_RING_SIZE) ||
+	    !genltest_has(&tb, GENLTEST_A_RING_COUNT)) {
+		return NL_SKIP;
+	}
+	info->size    = tb.ring_size;
+	info->count   = tb.ring_count;
+	info->dropped = genltest_has(&tb, GENLTEST_A_RING_DROPPED) ?
+				tb.ring_dropped :
+				0;
+
+	return NL_OK;
+}
+
+/* Ask for the pings to groups to go into the rings, and for their layout */
+static int ring_subscribe(struct genltest *gt, uint32_t groups,
+			  struct ring_info *info)
+{
+	int		err;
+	struct nl_sock *sk  = genltest_sock(gt);
+	struct nl_msg  *msg = genltest_msg(gt, GENLTEST_CMD_RING, 0,
+					   NL_AUTO_SEQ);
+	if (!msg) {
+		return -NLE_NOMEM;
+	}
+
+	if (nla_put_u32(msg, GENLTEST_A_RING_GROUPS, groups) < 0) {
+		genltest_msg_put(gt, msg);
+		return -NLE_MSGSIZE;
+	}
+	*info = (struct ring_info){ 0 };
+	if ((err = genltest_send(gt, msg)) ||
+	    (err = nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
+				       ring_info_handler, info)) ||
+	    (err = recv_reply(gt)) < 0) {
+		return err;
+	}
+
+	return info->size && info->count ? 0 : -NLE_MISSING_ATTR;
+}
+
+/*
+ * Say that we are going to sleep, and sleep in poll() until any ring gets a
+ * record, or for a second at most, so that summaries are still printed. The
+ * kernel looks at the rings once more before sleeping, so records that came
+ * right before we set the flags are not missed.
+ */
+static int ring_sleep(int fd, char *area, size_t stride, uint32_t count)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	int	      ret;
+
+	for (uint32_t i = 0; i < count; i++) {
+		struct genltest_ring *hdr = (void *)(area + i * stride);
+
+		__atomic_store_n(&hdr->waiting, 1, __ATOMIC_SEQ_CST);
+	}
+	ret = poll(&pfd, 1, 1000);
+	for (uint32_t i = 0; i < count; i++) {
+		struct genltest_ring *hdr = (void *)(area + i * stride);
+
+		__atomic_store_n(&hdr->waiting, 0, __ATOMIC_RELAXED);
+	}
+
+	return ret < 0 && errno != EINTR ? -errno : 0;
+}
+
+/*
+ * Read pings from the shared rings of the module instead of from multicast.
+ * While they keep coming not a single syscall is made, records are read in
+ * place straight from the rings, and only once all of them have been empty
+ * for RING_SPIN passes do we sleep. A summary is printed once per second, like
+ * in rate mode.
+ */
+static int ring_consume(const struct ring_info *info)
+{
+	long		   page	  = sysconf(_SC_PAGESIZE);
+	size_t		   stride = page + info->size;
+	size_t		   len	  = stride * info->count;
+	unsigned int	   idle	  = 0;
+	unsigned long long nrecs = 0, nbytes = 0, bad = 0;
+	struct timespec	   last, now;
+	char		  *area;
+	int		   ret = 0, fd;
+
+	if ((fd = open("/dev/" GENLTEST_DEV_NAME, O_RDWR)) < 0) {
+		return -errno;
+	}
+	area = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (area == MAP_FAILED) {
+		ret = -errno;
+		close(fd);
+		return ret;
+	}
+
+	printf("reading %u rings of %u bytes, %llu dropped before\n",
+	       info->count, info->size, (unsigned long long)info->dropped);
+	clock_gettime(CLOCK_MONOTONIC, &last);
+	while (1) {
+		unsigned long long dropped = 0, n = 0;
+
+		for (uint32_t i = 0; i < info->count; i++) {
+			char		     *base = area + i * stride;
+			struct genltest_ring *hdr  = (void *)base;
+			char		     *data = base + page;
+			uint32_t	      tail = hdr->tail;
+			uint32_t head = __atomic_load_n(&hdr->head,
+							__ATOMIC_ACQUIRE);
+
+			while (tail != head) {
+				struct genltest_ring_rec *rec =
+					(void *)(data +
+						 (tail & (info->size - 1)));
+				uint32_t rlen = rec->len;
+
+				/* Nonsense, skip whatever is in the ring */
+				if (rlen < sizeof(*rec) ||
+				    rlen % GENLTEST_RING_REC_ALIGN ||
+				    rlen > head - tail) {
+					bad++;
+					tail = head;
+					break;
+				}
+				if (rec->group != GENLTEST_RING_PAD) {
+					nbytes += rec->data_len;
+					n++;
+				}
+				tail += rlen;
+			}
+			/* Done with the records, the kernel can reuse them */
+			__atomic_store_n(&hdr->tail, tail, __ATOMIC_RELEASE);
+			dropped += hdr->dropped;
+		}
+		nrecs += n;
+
+		if (n) {
+			idle = 0;
+		} else if (++idle == RING_SPIN) {
+			if ((ret = ring_sleep(fd, area, stride, info->count))) {
+				break;
+			}
+			idle = 0;
+		}
+
+		/* The vDSO makes this no syscall either */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		double elapsed = (now.tv_sec - last.tv_sec) +
+				 (now.tv_nsec - last.tv_nsec) / 1e9;
+		if (elapsed < 1.0) {
+			continue;
+		}
+
+		printf("%.0f msg/s %.2f MB/s, %llu dropped, %llu bad\n",
+		       nrecs / elapsed, nbytes / elapsed / 1e6, dropped, bad);
+		fflush(stdout);
+		nrecs = nbytes = 0;
+		last  = now;
+	}
+
+	munmap(area, len);
+	close(fd);
+
+	return ret;
+}
+
+/* Ring mode: pings to groups are read from the rings and nothing else */
+static int ring_main(struct genltest *gt, const char *const *groups,
+		     unsigned int ngroups)
+{
+	int		 ret;
+	uint32_t	 mask = ngroups ? 0 : 1u << GENLTEST_MCGRP_DEFAULT;
+	struct ring_info info;
+
+	for (unsigned int i = 0; i < ngroups; i++) {
+		int g = 0;
+
+		while (g < __GENLTEST_MCGRP_MAX &&
+		       strcmp(mcgrp_names[g], groups[i])) {
+			g++;
+		}
+		if (g == __GENLTEST_MCGRP_MAX) {
+			prerr("unknown multicast group %s\n", groups[i]);
+			return -EINVAL;
+		}
+		mask |= 1u << g;
+	}
+
+	/* Once more if the ids were stale, they are not any longer */
+	if ((ret = ring_subscribe(gt, mask, &info)) < 0 &&
+	    genltest_recover(gt, ret)) {
+		ret = ring_subscribe(gt, mask, &info);
+	}
+	if (ret < 0) {
+		prerr("failed to subscribe to the rings: %s\n",
+		      nl_geterror(ret));
+		return ret;
+	}
+	if ((ret = ring_consume(&info))) {
+		prerr("failed to read the rings: %s\n", strerror(-ret));
+	}
+
+	return ret;
+}
+
+/*
+ * Ping count times through the device of the module. Every iovec of a writev()
+ * is one ping, so that it takes count / IOV_MAX syscalls instead of count.
+ * Unless ping_block is set, going over ping_rate makes writes fail with EAGAIN
+ * or come out short, in which case we back off for a bit before going on.
+ */
+static int send_pings(unsigned int count)
+{
+	static char  bufs[IOV_MAX][BATCH_MSG_LEN];
+	struct iovec iovs[IOV_MAX];
+	unsigned int sent = 0, writes = 0, throttled = 0;
+	int	     ret = 0, fd = open("/dev/" GENLTEST_DEV_NAME, O_WRONLY);
+
+	if (fd < 0) {
+		return -errno;
+	}
+
+	while (sent < count) {
+		unsigned int n = count - sent;
+		ssize_t	     len;
+
+		n = n < IOV_MAX ? n : IOV_MAX;
+
+		for (unsigned int i = 0; i < n; i++) {
+			iovs[i].iov_base = bufs[i];
+			iovs[i].iov_len	 = snprintf(bufs[i], sizeof(bufs[i]),
+						    ECHO_MSG " #%u", sent + i);
+		}
+		len = writev(fd, iovs, n);
+		if (len < 0 && errno == EAGAIN) {
+			throttled++;
+			usleep(1000);
+			continue;
+		}
+		if (len <= 0) {
+			ret = len < 0 ? -errno : -EIO;
+			break;
+		}
+		writes++;
+
+		/* A short write still stops right after one of the pings */
+		for (unsigned int i = 0; i < n && len > 0; i++) {
+			len -= iovs[i].iov_len;
+			sent++;
+		}
+	}
+	close(fd);
+	printf("%u pings sent in %u writes, throttled %u times\n", sent, writes,
+	       throttled);
+
+	return ret;
+}
+
+/*
+ * Receive everything that is waiting in a non-blocking socket. Returns the
+ * number of messages parsed, or a negative libnl error.
+ */
+static int recv_all(struct nl_sock *sk, struct mc_track *t)
+{
+	int	      ret, total = 0;
+	struct nl_cb *cb = nl_socket_get_cb(sk);
+
+	while ((ret = nl_recvmsgs_report(sk, cb)) != 0) {
+		/* libnl reports ENOBUFS as NLE_NOMEM */
+		if (ret == -NLE_NOMEM && t) {
+			t->overruns++;
+			prerr("socket overrun, %llu so far\n", t->overruns);
+			continue;
+		}
+		if (ret < 0) {
+			break;
+		}
+		total += ret;
+	}
+	nl_cb_put(cb);
+
+	return ret < 0 && ret != -NLE_AGAIN ? ret : total;
+}
+
+/*
+ * Service both sockets from a single thread: multicast notifications as they
+ * come, and, if p isn't NULL, replies to echoes pipelined on the unicast
+ * socket, sending new ones as soon as there's room in the window. Only returns
+ * if it can't go on, with a negative libnl error, syscalls' errors included.
+ */
+static int event_loop(struct nl_sock *ucsk, struct nl_sock *mcsk,
+		      struct pipeline *p, struct mc_track *t)
+{
+	int		   ret = 0, ep = epoll_create1(EPOLL_CLOEXEC);
+	bool		   reported = false;
+	struct epoll_event ev, evs[2];
+
+	if (ep < 0) {
+		return -nl_syserr2nlerr(errno);
+	}
+	ev = (struct epoll_event){ .events = EPOLLIN, .data.ptr = ucsk };
+	if (nl_socket_set_nonblocking(ucsk) ||
+	    nl_socket_set_nonblocking(mcsk) ||
+	    epoll_ctl(ep, EPOLL_CTL_ADD, nl_socket_get_fd(ucsk), &ev)) {
+		ret = -nl_syserr2nlerr(errno);
+		goto out;
+	}
+	ev.data.ptr = mcsk;
+	if (epoll_ctl(ep, EPOLL_CTL_ADD, nl_socket_get_fd(mcsk), &ev)) {
+		ret = -nl_syserr2nlerr(errno);
+		goto out;
+	}
+
+	if (p && (ret = pipeline_fill(p))) {
+		prerr("failed to send echo: %s\n", nl_geterror(ret));
+		goto out;
+	}
+	while (1) {
+		int n = epoll_wait(ep, evs, 2, -1);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			ret = -nl_syserr2nlerr(errno);
+			break;
+		}
+
+		for (int i = 0; i < n; i++) {
+			struct nl_sock *sk = evs[i].data.ptr;
+
+			if ((ret = recv_all(sk, sk == mcsk ? t : NULL)) < 0) {
+				prerr("failed to receive: %s\n",
+				      nl_geterror(ret));
+			}
+		}
+
+		if (!p) {
+			continue;
+		}
+		if ((ret = pipeline_fill(p))) {
+			prerr("failed to send echo: %s\n", nl_geterror(ret));
+			break;
+		}
+		if (!reported && p->done + p->failed == p->count) {
+			pipeline_report(p);
+			reported = true;
+		}
+	}
+
+out:
+	close(ep);
+	return ret;
+}
+
+/*
+ * soak subcommand: echoes, multicast listeners and ping producers all at the
+ * same time for a while, to see how the module holds up under a mix that stays
+ * on, whether it leaks skbs, and whether it got slower than a baseline, that is
+ * a previous run saved with -o json.
+ */
+
+/* Defaults of the soak subcommand */
+#define SOAK_DEFAULT_SECS      10
+#define SOAK_DEFAULT_TOLERANCE 10
+/*
+ * Most skbs that a soak can leave behind, a leak in any error path that it
+ * goes through adds up to way more than that. The rest of the system allocates
+ * some of its own in the meantime too.
+ */
+#define SOAK_DEFAULT_MAX_SKBS 256
+/* RTTs kept by each echo thread, a uniform sample of all of them past that */
+#define SOAK_SAMPLES (1 << 18)
+/* Pings in each write of the producers */
+#define SOAK_PING_IOVS 64
+/* How long to wait after the soak for what's in flight to be freed */
+#define SOAK_SETTLE_SECS 1
+
+#define SOAK_BURST_PATH "/sys/" GENLTEST_GENL_NAME "/ping_burst"
+
+/* Set once the soak is over, for all of the threads to stop */
+static bool soak_stop;
+
+static inline bool soak_stopped(void)
+{
+	return __atomic_load_n(&soak_stop, __ATOMIC_RELAXED);
+}
+
+/* State of each of the threads sending echoes */
+struct soak_echo {
+	pthread_t	   tid;
+	int		   cpu;
+	unsigned int	   seed;
+	uint64_t	  *rtts;
+	unsigned long long done;
+	unsigned long long failed;
+};
+
+/*
+ * Echo one at a time until the soak is over. There's no telling how many RTTs
+ * there will be, so only SOAK_SAMPLES of them are kept, replaced at random as
+ * more come in so that every one of them has the same chance of being kept.
+ */
+static void *soak_echo_fn(void *arg)
+{
+	struct soak_echo  *e = arg;
+	struct genltest	  *gt;
+	struct nl_sock	  *sk;
+	unsigned long long replies = 0;
+
+	pin_cpu(e->cpu);
+
+	if (genltest_open(&gt)) {
+		e->failed++;
+		return NULL;
+	}
+	sk = genltest_sock(gt);
+	if (nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM, count_handler,
+				&replies)) {
+		e->failed++;
+		genltest_close(gt);
+		return NULL;
+	}
+	nl_socket_disable_auto_ack(sk);
+
+	while (!soak_stopped()) {
+		uint64_t	   t0 = now_ns(), rtt;
+		unsigned long long i;
+
+		int err;
+
+		if ((err = genltest_echo(gt, ECHO_MSG, NL_AUTO_SEQ)) ||
+		    (err = nl_recvmsgs_default(sk)) < 0) {
+			genltest_recover(gt, err);
+			e->failed++;
+			continue;
+		}
+		rtt = now_ns() - t0;
+
+		i = e->done++;
+		if (i >= SOAK_SAMPLES) {
+			i = ((unsigned long long)rand_r(&e->seed) << 31 |
+			     rand_r(&e->seed)) %
+			    e->done;
+		}
+		if (i < SOAK_SAMPLES) {
+			e->rtts[i] = rtt;
+		}
+	}
+
+	genltest_close(gt);
+
+	return NULL;
+}
+
+/* State of each of the multicast listeners, which join all of the groups */
+struct soak_listen {
+	pthread_t	   tid;
+	struct genltest	  *gt;
+	struct mc_track	   track;
+	unsigned long long received;
+	int		   err;
+};
+
+/*
+ * Count the notifications that arrive, and how many were lost, the same way
+ * that the rate mode does, until the soak is over.
+ */
+static void *soak_listen_fn(void *arg)
+{
+	struct soak_listen *l	= arg;
+	int		    fd	= nl_socket_get_fd(genltest_sock(l->gt));
+	char		   *buf = malloc(RING_BUF_LEN);
+	/* Wake up now and then to find out if the soak is over */
+	struct timeval timeout = { .tv_usec = 100000 };
+
+	if (!buf) {
+		l->err = -ENOMEM;
+		return NULL;
+	}
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+		       sizeof(timeout))) {
+		l->err = -errno;
+		free(buf);
+		return NULL;
+	}
+
+	while (!soak_stopped()) {
+		ssize_t len = recv(fd, buf, RING_BUF_LEN, 0);
+
+		if (len < 0) {
+			if (errno == ENOBUFS) {
+				l->track.overruns++;
+			} else if (errno != EAGAIN && errno != EINTR) {
+				l->err = -errno;
+				break;
+			}
+			continue;
+		}
+		l->received += count_payloads(buf, len, &l->track);
+	}
+	free(buf);
+
+	return NULL;
+}
+
+/* State of each of the threads pinging through the device of the module */
+struct soak_ping {
+	pthread_t	   tid;
+	unsigned long long sent;
+	unsigned long long throttled;
+	int		   err;
+};
+
+/*
+ * Ping SOAK_PING_IOVS at a time until the soak is over, backing off for a bit
+ * whenever ping_rate says so, like send_pings().
+ */
+static void *soak_ping_fn(void *arg)
+{
+	struct soak_ping *p = arg;
+	struct iovec	  iovs[SOAK_PING_IOVS];
+	int		  fd = open("/dev/" GENLTEST_DEV_NAME, O_WRONLY);
+
+	if (fd < 0) {
+		p->err = -errno;
+		return NULL;
+	}
+	for (int i = 0; i < SOAK_PING_IOVS; i++) {
+		iovs[i].iov_base = ECHO_MSG;
+		iovs[i].iov_len	 = sizeof(ECHO_MSG) - 1;
+	}
+
+	while (!soak_stopped()) {
+		ssize_t len = writev(fd, iovs, SOAK_PING_IOVS);
+
+		if (len < 0 && (errno == EAGAIN || errno == EINTR)) {
+			p->throttled += errno == EAGAIN;
+			usleep(1000);
+			continue;
+		}
+		if (len <= 0) {
+			p->err = len < 0 ? -errno : -EIO;
+			break;
+		}
+		/* A short write still stops right after one of the pings */
+		p->sent += len / iovs[0].iov_len;
+	}
+	close(fd);
+
+	return NULL;
+}
+
+/* State of the thread starting bursts of pings from the module itself */
+struct soak_burst {
+	pthread_t	   tid;
+	unsigned int	   count;
+	unsigned long long bursts;
+	unsigned long long sent;
+	int		   err;
+};
+
+/* Write str to the ping_burst attr of the module */
+static int burst_write(const char *str)
+{
+	int fd = open(SOAK_BURST_PATH, O_WRONLY), ret = 0;
+
+	if (fd < 0) {
+		return -errno;
+	}
+	if (write(fd, str, strlen(str)) < 0) {
+		ret = -errno;
+	}
+	close(fd);
+
+	return ret;
+}
+
+/*
+ * Read the state of the last burst from the ping_burst attr. Returns whether
+ * it's still running, or a negative errno.
+ */
+static int burst_read(unsigned long long *sent)
+{
+	char	buf[512];
+	ssize_t len;
+	int	running, fd = open(SOAK_BURST_PATH, O_RDONLY);
+	char   *p;
+
+	if (fd < 0) {
+		return -errno;
+	}
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len < 0) {
+		return -errno;
+	}
+	buf[len] = '\0';
+
+	if (!(p = strstr(buf, "running ")) || sscanf(p, "running %d",
+						       &running) != 1 ||
+	    !(p = strstr(buf, "\nsent ")) || sscanf(p, "\nsent %llu",
+						      sent) != 1) {
+		return -EINVAL;
+	}
+
+	return running;
+}
+
+/* Start a burst of b->count pings as soon as the last one is over */
+static void *soak_burst_fn(void *arg)
+{
+	struct soak_burst *b = arg;
+	char		   cmd[16];
+	unsigned long long sent;
+	int		   ret;
+
+	snprintf(cmd, sizeof(cmd), "%u\n", b->count);
+
+	while (!soak_stopped()) {
+		if ((ret = burst_write(cmd)) == -EBUSY) {
+			usleep(10000);
+			continue;
+		}
+		if (ret) {
+			b->err = ret;
+			return NULL;
+		}
+		b->bursts++;
+
+		while ((ret = burst_read(&sent)) > 0 && !soak_stopped()) {
+			usleep(10000);
+		}
+		/* Cut the last one short if the soak is over before it is */
+		if (ret > 0) {
+			burst_write("0\n");
+			ret = burst_read(&sent);
+		}
+		if (ret < 0) {
+			b->err = ret;
+			return NULL;
+		}
+		b->sent += sent;
+	}
+
+	return NULL;
+}
+
+/* Handler for the reply to GENLTEST_CMD_GET_STATS, which it parses into arg */
+static int stats_tb_handler(struct nl_msg *msg, void *arg)
+{
+	struct nlmsghdr	  *nlh = nlmsg_hdr(msg);
+	struct genltest_tb tb;
+
+	if (genltest_parse(&tb, genltest_attrs(nlh), genltest_attrs_len(nlh)) ||
+	    !genltest_has(&tb, GENLTEST_A_STATS) ||
+	    genltest_stats_parse(arg, genltest_nla_data(tb.stats),
+				 genltest_nla_len(tb.stats))) {
+		return NL_SKIP;
+	}
+
+	return NL_OK;
+}
+
+/* Read the statistics of the module into st */
+static int soak_read_stats(struct genltest *gt, struct genltest_stats_tb *st)
+{
+	struct nl_sock *sk = genltest_sock(gt);
+	int		err;
+
+	memset(st, 0, sizeof(*st));
+	if ((err = nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
+				       stats_tb_handler, st)) ||
+	    (err = send_get_stats(gt))) {
+		return err;
+	}
+
+	return recv_reply(gt);
+}
+
+/*
+ * Slab memory in kB, from /proc/meminfo, and active skbs from
+ * /proc/slabinfo, which only root can read. -1 for what can't be read.
+ */
+static void soak_read_mem(long long *slab_kb, long long *skbs)
+{
+	char  line[512];
+	FILE *f;
+
+	*slab_kb = *skbs = -1;
+	if ((f = fopen("/proc/meminfo", "r"))) {
+		while (fgets(line, sizeof(line), f)) {
+			if (sscanf(line, "Slab: %lld kB", slab_kb) == 1) {
+				break;
+			}
+		}
+		fclose(f);
+	}
+	if ((f = fopen("/proc/slabinfo", "r"))) {
+		while (fgets(line, sizeof(line), f)) {
+			if (sscanf(line, "skbuff_head_cache %lld", skbs) == 1) {
+				break;
+			}
+		}
+		fclose(f);
+	}
+}
+
+/*
+ * What a soak measured, printed in the order of the table, and compared with
+ * the baseline for those that say which way is better.
+ */
+struct soak_metric {
+	const char *key;
+	int	    prec;
+	/* 1 if higher is better, -1 if lower is, 0 to not compare it */
+	int	    better;
+	double	    val;
+};
+
+/* The number of key in the flat JSON object in buf, as output by soak */
+static bool json_number(const char *buf, const char *key, double *val)
+{
+	char	    pat[64];
+	const char *p;
+
+	snprintf(pat, sizeof(pat), "\"%s\":", key);
+	if (!(p = strstr(buf, pat))) {
+		return false;
+	}
+	*val = strtod(p + strlen(pat), NULL);
+
+	return true;
+}
+
+/*
+ * Compare the n metrics in m with the ones of the baseline at path. Returns
+ * the number of them that are worse by more than tolerance percent, or -1 if
+ * the baseline can't be read. Metrics that were 0 in the baseline, because it
+ * didn't run that part, are skipped.
+ */
+static int soak_compare(const char *path, const struct soak_metric *m,
+			size_t n, double tolerance)
+{
+	char	buf[4096];
+	size_t	len;
+	int	worse = 0;
+	FILE   *f = fopen(path, "r");
+
+	if (!f) {
+		prerr("failed to open baseline %s: %s\n", path,
+		      strerror(errno));
+		return -1;
+	}
+	len	 = fread(buf, 1, sizeof(buf) - 1, f);
+	buf[len] = '\0';
+	fclose(f);
+
+	for (size_t i = 0; i < n; i++) {
+		double base, change;
+
+		if (!m[i].better || !json_number(buf, m[i].key, &base) ||
+		    !base) {
+			continue;
+		}
+		change = (m[i].val - base) / base * 100;
+		if (change * m[i].better < -tolerance) {
+			fprintf(stderr,
+				"REGRESSION: %s %.*f, baseline %.*f, %+.1f%%\n",
+				m[i].key, m[i].prec, m[i].val, m[i].prec, base,
+				change);
+			worse++;
+		}
+	}
+
+	return worse;
+}
+
+static void soak_usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s soak [-t secs] [-c threads] [-l listeners] "
+		"[-p producers] [-B count]\n"
+		"       [-b baseline] [-T percent] [-L skbs] [-o text|json]\n"
+		"  -t secs       how long to soak for (default %u)\n"
+		"  -c threads    threads echoing one at a time (default 1)\n"
+		"  -l listeners  sockets joining all of the groups (default "
+		"1)\n"
+		"  -p producers  threads pinging through /dev/" GENLTEST_DEV_NAME
+		" (default 1)\n"
+		"  -B count      also a burst of count pings from the module "
+		"after another\n"
+		"  -b baseline   output of a previous soak -o json to compare "
+		"with\n"
+		"  -T percent    how much worse than the baseline fails "
+		"(default %u)\n"
+		"  -L skbs       most skbs the soak can leave behind (default "
+		"%u), -1 not to check\n"
+		"  -o format     output format (default text)\n"
+		"Exits with 2 if it's worse than the baseline or leaks, 1 on "
+		"errors.\n",
+		prog, SOAK_DEFAULT_SECS, SOAK_DEFAULT_TOLERANCE,
+		SOAK_DEFAULT_MAX_SKBS);
+}
+
+static int soak_main(const char *prog, int argc, char *argv[])
+{
+	int			 ret = 1, opt, err = 0;
+	unsigned int		 secs = SOAK_DEFAULT_SECS, njobs = 1;
+	unsigned int		 nlisten = 1, nping = 1, burst_count = 0;
+	/* Threads of each kind actually started, the only ones to join */
+	unsigned int		 nlisten_run = 0, njobs_run = 0, nping_run = 0;
+	bool			 burst_run = false;
+	double			 tolerance = SOAK_DEFAULT_TOLERANCE;
+	long long		 max_skbs = SOAK_DEFAULT_MAX_SKBS;
+	long long		 slab0, skbs0, slab1, skbs1;
+	const char		*baseline = NULL;
+	bool			 json = false;
+	long			 ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	uint64_t		*rtts = NULL, start, elapsed_ns;
+	size_t			 nrtts = 0;
+	struct soak_echo	*echoes = NULL;
+	struct soak_listen	*listens = NULL;
+	struct soak_ping	*pings = NULL;
+	struct soak_burst	 burst = { 0 };
+	struct genltest_stats_tb st0, st1;
+	struct genltest		*gt;
+
+	while ((opt = getopt(argc, argv, "t:c:l:p:B:b:T:L:o:h")) != -1) {
+		switch (opt) {
+		case 't':
+			secs = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			njobs = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			nlisten = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			nping = strtoul(optarg, NULL, 0);
+			break;
+		case 'B':
+			burst_count = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			baseline = optarg;
+			break;
+		case 'T':
+			tolerance = strtod(optarg, NULL);
+			break;
+		case 'L':
+			max_skbs = strtoll(optarg, NULL, 0);
+			break;
+		case 'o':
+			if (strcmp(optarg, "text") && strcmp(optarg, "json")) {
+				soak_usage(prog);
+				return 1;
+			}
+			json = !strcmp(optarg, "json");
+			break;
+		default:
+			soak_usage(prog);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (!secs) {
+		soak_usage(prog);
+		return 1;
+	}
+
+	if ((ret = genltest_open(&gt))) {
+		prerr("failed to open generic netlink family: %s\n",
+		      nl_geterror(ret));
+		return 1;
+	}
+	ret = 1;
+
+	echoes	= calloc(njobs, sizeof(*echoes));
+	listens = calloc(nlisten, sizeof(*listens));
+	pings	= calloc(nping, sizeof(*pings));
+	rtts	= calloc((size_t)njobs * SOAK_SAMPLES, sizeof(*rtts));
+	if ((njobs && (!echoes || !rtts)) || (nlisten && !listens) ||
+	    (nping && !pings)) {
+		prerr("out of memory\n");
+		goto out;
+	}
+
+	/* The listeners join before anything is sent, so they miss nothing */
+	for (unsigned int i = 0; i < nlisten; i++) {
+		struct soak_listen *l = &listens[i];
+
+		if ((ret = genltest_open(&l->gt))) {
+			prerr("failed to open generic netlink family: %s\n",
+			      nl_geterror(ret));
+			goto out_listens;
+		}
+		l->track.gt = l->gt;
+		for (int g = 0; g < __GENLTEST_MCGRP_MAX; g++) {
+			if ((ret = genltest_subscribe(l->gt,
+						      mcgrp_names[g])) < 0) {
+				prerr("failed to join multicast group %s: "
+				      "%s\n",
+				      mcgrp_names[g], nl_geterror(ret));
+				goto out_listens;
+			}
+		}
+	}
+
+	if ((ret = soak_read_stats(gt, &st0)) < 0) {
+		prerr("failed to read stats: %s\n", nl_geterror(ret));
+		goto out_listens;
+	}
+	soak_read_mem(&slab0, &skbs0);
+
+	/*
+	 * Once a thread can't be created, no more are, and the soak goes on
+	 * with those already running, only to fail in the end.
+	 */
+	start = now_ns();
+	for (; nlisten_run < nlisten && !err; nlisten_run++) {
+		if ((err = pthread_create(&listens[nlisten_run].tid, NULL,
+					  soak_listen_fn,
+					  &listens[nlisten_run]))) {
+			break;
+		}
+	}
+	for (; njobs_run < njobs && !err; njobs_run++) {
+		struct soak_echo *e = &echoes[njobs_run];
+
+		e->cpu	= njobs_run % ncpus;
+		e->seed = njobs_run + 1;
+		e->rtts = rtts + (size_t)njobs_run * SOAK_SAMPLES;
+		if ((err = pthread_create(&e->tid, NULL, soak_echo_fn, e))) {
+			break;
+		}
+	}
+	for (; nping_run < nping && !err; nping_run++) {
+		if ((err = pthread_create(&pings[nping_run].tid, NULL,
+					  soak_ping_fn, &pings[nping_run]))) {
+			break;
+		}
+	}
+	if (burst_count && !err) {
+		burst.count = burst_count;
+		err = pthread_create(&burst.tid, NULL, soak_burst_fn, &burst);
+		burst_run = !err;
+	}
+	if (err) {
+		prerr("failed to create thread: %s\n", strerror(err));
+	}
+
+	sleep(secs);
+	__atomic_store_n(&soak_stop, true, __ATOMIC_RELAXED);
+	elapsed_ns = now_ns() - start;
+
+	/* Gather everything, the RTTs without holes */
+	for (unsigned int i = 0; i < njobs_run; i++) {
+		struct soak_echo *e = &echoes[i];
+		size_t		  n;
+
+		pthread_join(e->tid, NULL);
+		n = e->done < SOAK_SAMPLES ? e->done : SOAK_SAMPLES;
+		memmove(rtts + nrtts, e->rtts, n * sizeof(*rtts));
+		nrtts += n;
+	}
+	for (unsigned int i = 0; i < nping_run; i++) {
+		pthread_join(pings[i].tid, NULL);
+	}
+	if (burst_run) {
+		pthread_join(burst.tid, NULL);
+	}
+	for (unsigned int i = 0; i < nlisten_run; i++) {
+		pthread_join(listens[i].tid, NULL);
+	}
+	qsort(rtts, nrtts, sizeof(*rtts), cmp_u64);
+
+	sleep(SOAK_SETTLE_SECS);
+	if ((ret = soak_read_stats(gt, &st1)) < 0) {
+		prerr("failed to read stats: %s\n", nl_geterror(ret));
+		goto out_listens;
+	}
+	soak_read_mem(&slab1, &skbs1);
+	ret = err ? 1 : 0;
+
+	unsigned long long echoed = 0, echo_failed = 0, pinged = 0;
+	unsigned long long throttled = 0, received = 0, lost = 0, overruns = 0;
+	double		   elapsed = elapsed_ns / 1e9;
+
+	for (unsigned int i = 0; i < njobs; i++) {
+		echoed += echoes[i].done;
+		echo_failed += echoes[i].failed;
+	}
+	for (unsigned int i = 0; i < nping; i++) {
+		if (pings[i].err) {
+			prerr("failed to ping: %s\n", strerror(-pings[i].err));
+			ret = 1;
+		}
+		pinged += pings[i].sent;
+		throttled += pings[i].throttled;
+	}
+	if (burst.err) {
+		prerr("failed to burst: %s\n", strerror(-burst.err));
+		ret = 1;
+	}
+	for (unsigned int i = 0; i < nlisten; i++) {
+		if (listens[i].err) {
+			prerr("failed to receive: %s\n",
+			      strerror(-listens[i].err));
+			ret = 1;
+		}
+		received += listens[i].received;
+		lost += listens[i].track.lost;
+		overruns += listens[i].track.overruns;
+	}
+	if (echo_failed) {
+		ret = 1;
+	}
+
+	struct soak_metric m[] = {
+		{ "secs", 3, 0, elapsed },
+		{ "echoes", 0, 0, echoed },
+		{ "echo_failed", 0, 0, echo_failed },
+		{ "echo_per_s", 1, 1, echoed / elapsed },
+		{ "p50_us", 1, -1, percentile(rtts, nrtts, 0.5) },
+		{ "p99_us", 1, -1, percentile(rtts, nrtts, 0.99) },
+		{ "p999_us", 1, -1, percentile(rtts, nrtts, 0.999) },
+		{ "max_us", 1, 0, percentile(rtts, nrtts, 1) },
+		{ "pings", 0, 0, pinged + burst.sent },
+		{ "ping_per_s", 1, 1, (pinged + burst.sent) / elapsed },
+		{ "throttled", 0, 0, throttled },
+		{ "bursts", 0, 0, burst.bursts },
+		{ "received", 0, 0, received },
+		{ "recv_per_s", 1, 1, received / elapsed },
+		{ "lost", 0, 0, lost },
+		{ "overruns", 0, 0, overruns },
+		{ "mc_failed", 0, 0, st1.mc_failed - st0.mc_failed },
+		{ "mc_qfull", 0, 0, st1.mc_qfull - st0.mc_qfull },
+		{ "enomem", 0, 0, st1.enomem - st0.enomem },
+		{ "emsgsize", 0, 0, st1.emsgsize - st0.emsgsize },
+		{ "slab_kb", 0, 0, slab0 < 0 || slab1 < 0 ? 0 : slab1 - slab0 },
+		{ "skbs", 0, 0, skbs0 < 0 || skbs1 < 0 ? 0 : skbs1 - skbs0 },
+	};
+	size_t nm = sizeof(m) / sizeof(m[0]);
+
+	for (size_t i = 0; i < nm; i++) {
+		if (json) {
+			printf("%s\"%s\": %.*f", i ? ", " : "{", m[i].key,
+			       m[i].prec, m[i].val);
+		} else {
+			printf("%s %.*f\n", m[i].key, m[i].prec, m[i].val);
+		}
+	}
+	if (json) {
+		printf("}\n");
+	}
+
+	/*
+	 * An skb that was leaked is still there once everything settled, which
+	 * is all that can be told from the outside.
+	 */
+	if (max_skbs >= 0 && (skbs0 < 0 || skbs1 < 0)) {
+		prerr("can't check for leaks without /proc/slabinfo\n");
+	} else if (max_skbs >= 0 && skbs1 - skbs0 > max_skbs) {
+		fprintf(stderr,
+			"LEAK: %lld more skbs than before, at most %lld\n",
+			skbs1 - skbs0, max_skbs);
+		ret = 2;
+	}
+	if (baseline) {
+		int worse = soak_compare(baseline, m, nm, tolerance);
+
+		if (worse < 0) {
+			ret = 1;
+		} else if (worse) {
+			ret = 2;
+		}
+	}
+
+out_listens:
+	for (unsigned int i = 0; i < nlisten; i++) {
+		if (listens[i].gt) {
+			genltest_close(listens[i].gt);
+		}
+	}
+out:
+	genltest_close(gt);
+	free(echoes);
+	free(listens);
+	free(pings);
+	free(rtts);
+	return ret;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-b count] [-d count] [-s] [-r] [-R bytes] [-N] "
+		"[-e count] [-w depth]\n"
+		"          [-g group]...\n"
+		"       %s -m [-g group]...\n"
+		"       %s -j threads [-n count]\n"
+		"       %s -p count\n"
+		"       %s bench [options], see %s bench -h\n"
+		"       %s soak [options], see %s soak -h\n"
+		"  -b count  also send a batch of count echo messages, %u at "
+		"most\n"
+		"  -d count  also request a dump of count echo messages\n"
+		"  -s        print the statistics of the module and exit\n"
+		"  -r        print multicast rates instead of each message\n"
+		"  -R bytes  size of the receive buffer of the multicast socket\n"
+		"  -N        don't report multicast socket overruns (ENOBUFS)\n"
+		"  -g group  multicast group to join, can be repeated (default "
+		GENLTEST_MC_GRP_NAME ")\n"
+		"  -j N      send echoes from N threads in parallel and exit\n"
+		"  -n count  echoes sent by each thread (default %u)\n"
+		"  -p count  ping count times through /dev/" GENLTEST_DEV_NAME
+		" and exit\n"
+		"  -e count  pipeline count echoes while listening\n"
+		"  -w depth  echoes in flight at the same time (default %u)\n"
+		"  -m        read the pings to the groups from the shared "
+		"rings of /dev/" GENLTEST_DEV_NAME "\n"
+		"  -P cpu    listen pinned to cpu, joining the group of its "
+		"NUMA node, which\n"
+		"            replaces the default group if there's no -g, see "
+		"ping_numa\n",
+		prog, prog, prog, prog, prog, prog, prog, prog,
+		(unsigned int)BATCH_MAX_COUNT, WORKER_DEFAULT_COUNT,
+		PIPELINE_DEFAULT_DEPTH);
+}
+
+int main(int argc, char *argv[])
+{
+	int		ret = 1, opt, rcvbuf = 0, pin = -1;
+	unsigned int	batch = 0, dump = 0, jobs = 0, pings = 0, echoes = 0;
+	unsigned int	depth = PIPELINE_DEFAULT_DEPTH;
+	unsigned int	count = WORKER_DEFAULT_COUNT;
+	bool		stats = false, rate = false, no_enobufs = false;
+	bool		ring = false;
+	/* Failures that don't stop the rest, but still fail in the end */
+	bool		failed = false;
+	const char     *groups[__GENLTEST_MCGRP_MAX];
+	unsigned int	ngroups = 0;
+	struct mc_track track = { 0 };
+	struct pipeline	 pipe;
+	struct genltest *uc = NULL, *mc = NULL;
+	struct nl_sock	*ucsk, *mcsk;
+
+	/* Subcommands */
+	if (argc > 1 && !strcmp(argv[1], "bench")) {
+		return bench_main(argv[0], argc - 1, argv + 1);
+	}
+	if (argc > 1 && !strcmp(argv[1], "soak")) {
+		return soak_main(argv[0], argc - 1, argv + 1);
+	}
+
+	while ((opt = getopt(argc, argv, "b:d:srR:Ng:j:n:p:e:w:mP:h")) != -1) {
+		switch (opt) {
+		case 'b':
+			batch = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			dump = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			stats = true;
+			break;
+		case 'r':
+			rate = true;
+			break;
+		case 'R':
+			rcvbuf = strtol(optarg, NULL, 0);
+			break;
+		case 'N':
+			no_enobufs = true;
+			break;
+		case 'g':
+			if (ngroups == __GENLTEST_MCGRP_MAX) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			groups[ngroups++] = optarg;
+			break;
+		case 'j':
+			jobs = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			pings = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			echoes = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			depth = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			ring = true;
+			break;
+		case 'P':
+			pin = strtol(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	/* Producing instead of listening, no netlink involved */
+	if (pings) {
+		if ((ret = send_pings(pings))) {
+			prerr("failed to ping: %s\n", strerror(-ret));
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	/*
+	 * We use one socket to receive asynchronous "notifications" over
+	 * multicast group, and another for ops. We do this so that we don't mix
+	 * up responses from ops with notifications to make handling easier.
+	 * Opening the handles also resolves the genl family, and all of its
+	 * groups with it. One family for both unicast and multicast.
+	 */
+	if ((ret = genltest_open(&uc)) || (ret = genltest_open(&mc))) {
+		prerr("failed to open generic netlink family: %s\n",
+		      nl_geterror(ret));
+		goto out;
+	}
+	ucsk	 = genltest_sock(uc);
+	mcsk	 = genltest_sock(mc);
+	track.gt = mc;
+
+	/*
+	 * Parallel echoes. Every thread opens its own socket, only the family
+	 * resolved above is shared.
+	 */
+	if (jobs) {
+		if ((ret = run_workers(jobs, count))) {
+			prerr("failed to run threads: %s\n", strerror(-ret));
+		}
+		goto out;
+	}
+
+	/*
+	 * Shared rings, instead of multicast. Not joining the groups on top of
+	 * that, or the module would multicast everything too.
+	 */
+	if (ring) {
+		ret = ring_main(uc, groups, ngroups);
+		goto out;
+	}
+
+	/* Disable sequence checks for asynchronous multicast messages. */
+	nl_socket_disable_seq_check(mcsk);
+
+	/*
+	 * A pinned listener joins the group of its node, where the module sends
+	 * the pings produced on that node with ping_numa set, so that they are
+	 * built, delivered and read all on the same node.
+	 */
+	if (pin >= 0) {
+		int node = pin_node(pin);
+
+		if (node < 0) {
+			prerr("failed to pin to cpu %d: %s\n", pin,
+			      strerror(-node));
+			ret = node;
+			goto out;
+		}
+		printf("listening on cpu %d, node %d\n", pin, node);
+		if (ngroups < __GENLTEST_MCGRP_MAX) {
+			groups[ngroups++] =
+				mcgrp_names[GENLTEST_MCGRP_NODE0 +
+					    node % GENLTEST_MCGRP_NODES];
+		}
+	}
+
+	/*
+	 * Resolve and join the multicast groups. Only those, notifications to
+	 * any other group never make it to our socket.
+	 */
+	if (!ngroups) {
+		groups[ngroups++] = GENLTEST_MC_GRP_NAME;
+	}
+	for (unsigned int i = 0; i < ngroups; i++) {
+		if ((ret = genltest_subscribe(mc, groups[i])) < 0) {
+			prerr("failed to join multicast group %s: %s\n",
+			      groups[i], nl_geterror(ret));
+			goto out;
+		}
+	}
+
+	/*
+	 * Also listen for the controller announcing family changes, so that a
+	 * module reload while we run does not leave a stale cache behind.
+	 */
+	if ((ret = genltest_watch(mc)) < 0) {
+		prerr("failed to join controller notifications: %s\n",
+		      nl_geterror(ret));
+		failed = true;
+	}
+
+	/* Make room for bursts of notifications if asked to. */
+	if (rcvbuf && (ret = set_rcvbuf(mcsk, rcvbuf))) {
+		prerr("failed to set receive buffer size: %s\n", strerror(-ret));
+		goto out;
+	}
+	if (no_enobufs && (ret = set_no_enobufs(mcsk))) {
+		prerr("failed to disable ENOBUFS: %s\n", strerror(-ret));
+		goto out;
+	}
+
+	if ((ret = set_cb(ucsk, NULL)) || (ret = set_cb(mcsk, &track))) {
+		prerr("failed to set callback: %s\n", nl_geterror(ret));
+		goto out;
+	}
+
+	/* Just the statistics, nothing else to do after that. */
+	if (stats) {
+		if ((ret = send_get_stats(uc))) {
+			prerr("failed to request stats: %s\n", nl_geterror(ret));
+		} else if ((ret = recv_reply(uc)) < 0) {
+			prerr("failed to receive stats: %s\n", nl_geterror(ret));
+		}
+		goto out;
+	}
+
+	/* Send unicast message and listen for response. */
+	if ((ret = genltest_echo(uc, ECHO_MSG, NL_AUTO_SEQ))) {
+		prerr("failed to send message: %s\n", nl_geterror(ret));
+		failed = true;
+	} else {
+		printf("message sent\n");
+		printf("listening for messages\n");
+		/* Stale ids are resolved again for the next requests */
+		if ((ret = recv_reply(uc)) < 0) {
+			prerr("failed to receive reply: %s\n", nl_geterror(ret));
+			failed = true;
+		}
+	}
+
+	/* Same thing, but for a whole batch of messages in one go. */
+	if (batch) {
+		if ((ret = send_echo_batch(ucsk, genltest_family(uc), batch))) {
+			prerr("failed to send batch: %s\n", nl_geterror(ret));
+			failed = true;
+		} else if ((ret = recv_reply(uc)) < 0) {
+			prerr("failed to receive batch: %s\n", nl_geterror(ret));
+			failed = true;
+		}
+	}
+
+	/*
+	 * And now as a dump. libnl keeps on receiving the multipart messages of
+	 * the dump until it gets NLMSG_DONE. No ACK is sent for dumps.
+	 */
+	if (dump) {
+		if ((ret = send_echo_dump(uc, dump))) {
+			prerr("failed to request dump: %s\n", nl_geterror(ret));
+			failed = true;
+		} else if ((ret = nl_recvmsgs_default(ucsk)) < 0) {
+			prerr("failed to receive dump: %s\n", nl_geterror(ret));
+			genltest_recover(uc, ret);
+			failed = true;
+		}
+	}
+
+	/* Listen for "notifications". */
+	if (rate) {
+		if ((ret = recv_rate(&track))) {
+			prerr("failed to receive: %s\n", strerror(-ret));
+		}
+		goto out;
+	}
+	if (echoes &&
+	    (ret = pipeline_init(&pipe, uc, echoes, depth ? depth : 1))) {
+		prerr("failed to set up pipeline: %s\n", strerror(-ret));
+		goto out;
+	}
+	ret = event_loop(ucsk, mcsk, echoes ? &pipe : NULL, &track);
+	if (echoes) {
+		free(pipe.slots);
+	}
+	if (ret) {
+		prerr("event loop failed: %s\n", nl_geterror(ret));
+	}
+
+out:
+	if (uc) {
+		genltest_close(uc);
+	}
+	if (mc) {
+		genltest_close(mc);
+	}
+	/* Errors have been told about already, the exit status just says so */
+	return ret < 0 || failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
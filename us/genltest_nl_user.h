@@ -0,0 +1,629 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Do not edit directly, auto-generated from: */
+/*	spec/genltest.yaml */
+/* by spec/genltest-gen.py, parsers and encoders for user space */
+
+/*
+ * Parsing and building of the messages of the family without libnl, or any
+ * other library. Parsers are a switch on the type of attribute, writing into
+ * fields at fixed offsets of a struct, instead of a table of attributes checked
+ * against a policy, and encoders write straight into the message. All of it
+ * works on plain buffers, and on libnl messages just as well, through
+ * nlmsg_hdr() and nlmsg_get_max_size().
+ */
+#ifndef GENLTEST_NL_USER_H
+#define GENLTEST_NL_USER_H
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+
+#include "../ks/genltest.h"
+
+/*
+ * Walking the attributes in a buffer of len bytes, stopping at the first one
+ * that goes out of bounds.
+ */
+static inline int genltest_nla_ok(const struct nlattr *nla, int rem)
+{
+	return rem >= (int)sizeof(*nla) && nla->nla_len >= sizeof(*nla) &&
+	       nla->nla_len <= rem;
+}
+
+static inline const struct nlattr *genltest_nla_next(const struct nlattr *nla,
+						     int *rem)
+{
+	*rem -= NLA_ALIGN(nla->nla_len);
+	return (const struct nlattr *)((const char *)nla +
+				       NLA_ALIGN(nla->nla_len));
+}
+
+#define genltest_nla_for_each(nla, attrs, len, rem)                            \
+	for ((nla) = (const struct nlattr *)(attrs), (rem) = (len);            \
+	     genltest_nla_ok(nla, rem); (nla) = genltest_nla_next(nla, &(rem)))
+
+static inline const void *genltest_nla_data(const struct nlattr *nla)
+{
+	return (const char *)nla + NLA_HDRLEN;
+}
+
+static inline int genltest_nla_len(const struct nlattr *nla)
+{
+	return nla->nla_len - NLA_HDRLEN;
+}
+
+/* Attributes of a genl message at nlh, and how many bytes of them there are */
+static inline const void *genltest_attrs(const struct nlmsghdr *nlh)
+{
+	return (const char *)nlh + NLMSG_HDRLEN + GENL_HDRLEN;
+}
+
+static inline int genltest_attrs_len(const struct nlmsghdr *nlh)
+{
+	return (int)nlh->nlmsg_len - NLMSG_HDRLEN - GENL_HDRLEN;
+}
+
+/*
+ * Reserve room for an attribute of len bytes at the end of the message at nlh,
+ * which is in a buffer of size bytes. Returns where its payload goes, or NULL
+ * if it doesn't fit.
+ */
+static inline void *genltest_nla_reserve(struct nlmsghdr *nlh, size_t size,
+					 __u16 type, size_t len)
+{
+	struct nlattr *nla;
+	size_t	       off = NLMSG_ALIGN(nlh->nlmsg_len);
+
+	if (NLA_HDRLEN + len > 0xffff ||
+	    off + NLA_ALIGN(NLA_HDRLEN + len) > size) {
+		return NULL;
+	}
+
+	nla	      = (struct nlattr *)((char *)nlh + off);
+	nla->nla_type = type;
+	nla->nla_len  = NLA_HDRLEN + len;
+	memset((char *)nla + nla->nla_len, 0,
+	       NLA_ALIGN(nla->nla_len) - nla->nla_len);
+	nlh->nlmsg_len = off + NLA_ALIGN(nla->nla_len);
+
+	return (char *)nla + NLA_HDRLEN;
+}
+
+/*
+ * Nests, started by genltest_nest_start() with the type of the nest, and ended
+ * by genltest_nest_end() once their attributes are in.
+ */
+static inline struct nlattr *genltest_nest_start(struct nlmsghdr *nlh,
+						 size_t size, __u16 type)
+{
+	void *data = genltest_nla_reserve(nlh, size, type | NLA_F_NESTED, 0);
+
+	return data ? (struct nlattr *)((char *)data - NLA_HDRLEN) : NULL;
+}
+
+static inline void genltest_nest_end(struct nlmsghdr *nlh, struct nlattr *nest)
+{
+	nest->nla_len = (char *)nlh + nlh->nlmsg_len - (char *)nest;
+}
+
+/*
+ * Attributes of genltest_attrs, as parsed by genltest_parse(). Scalars are
+ * already in their own types, the rest point into the message. present has the
+ * bit of the type of each attribute that was found, see genltest_has().
+ */
+struct genltest_tb {
+	__u64		     present;
+	const char	    *msg;
+	const struct nlattr *batch;
+	__u32		     count;
+	const struct nlattr *stats;
+	__u32		     seq;
+	const struct nlattr *data;
+	__u32		     mcgrp;
+	__u32		     ring_groups;
+	__u32		     ring_size;
+	__u32		     ring_count;
+	__u64		     ring_dropped;
+	__u32		     ring_index;
+	const struct nlattr *latency;
+};
+
+#define genltest_has(tb, type) (((tb)->present >> (type)) & 1)
+
+/*
+ * Parse the attributes of a message of genltest_attrs, len bytes of them at
+ * attrs, into tb. Attributes have to be long enough for their type and strings
+ * NUL terminated, unknown ones are skipped. Returns 0, or -EINVAL if something
+ * is off.
+ */
+static inline int genltest_parse(struct genltest_tb *tb, const void *attrs,
+				 int len)
+{
+	const struct nlattr *nla;
+	int		     rem;
+
+	tb->present = 0;
+	genltest_nla_for_each(nla, attrs, len, rem) {
+		unsigned int type = nla->nla_type & NLA_TYPE_MASK;
+		const void  *data = genltest_nla_data(nla);
+		int	     n	  = genltest_nla_len(nla);
+
+		switch (type) {
+		case GENLTEST_A_MSG:
+			if (n < 1 || ((const char *)data)[n - 1]) {
+				return -EINVAL;
+			}
+			tb->msg = data;
+			break;
+		case GENLTEST_A_BATCH:
+			tb->batch = nla;
+			break;
+		case GENLTEST_A_COUNT:
+			if (n < (int)sizeof(__u32)) {
+				return -EINVAL;
+			}
+			tb->count = *(const __u32 *)data;
+			break;
+		case GENLTEST_A_STATS:
+			tb->stats = nla;
+			break;
+		case GENLTEST_A_SEQ:
+			if (n < (int)sizeof(__u32)) {
+				return -EINVAL;
+			}
+			tb->seq = *(const __u32 *)data;
+			break;
+		case GENLTEST_A_DATA:
+			if (n > GENLTEST_DATA_MAX_LEN) {
+				return -EINVAL;
+			}
+			tb->data = nla;
+			break;
+		case GENLTEST_A_MCGRP:
+			if (n < (int)sizeof(__u32)) {
+				return -EINVAL;
+			}
+			tb->mcgrp = *(const __u32 *)data;
+			break;
+		case GENLTEST_A_RING_GROUPS:
+			if (n < (int)sizeof(__u32)) {
+				return -EINVAL;
+			}
+			tb->ring_groups = *(const __u32 *)data;
+			break;
+		case GENLTEST_A_RING_SIZE:
+			if (n < (int)sizeof(__u32)) {
+				return -EINVAL;
+			}
+			tb->ring_size = *(const __u32 *)data;
+			break;
+		case GENLTEST_A_RING_COUNT:
+			if (n < (int)sizeof(__u32)) {
+				return -EINVAL;
+			}
+			tb->ring_count = *(const __u32 *)data;
+			break;
+		case GENLTEST_A_RING_DROPPED:
+			if (n < (int)sizeof(__u64)) {
+				return -EINVAL;
+			}
+			/* Only 4 byte aligned without a pad */
+			memcpy(&tb->ring_dropped, data, sizeof(__u64));
+			break;
+		case GENLTEST_A_RING_INDEX:
+			if (n < (int)sizeof(__u32)) {
+				return -EINVAL;
+			}
+			tb->ring_index = *(const __u32 *)data;
+			break;
+		case GENLTEST_A_NOREPLY:
+			break;
+		case GENLTEST_A_LATENCY:
+			tb->latency = nla;
+			break;
+		default:
+			continue;
+		}
+		tb->present |= 1ULL << type;
+	}
+
+	return 0;
+}
+
+/*
+ * Attributes of genltest_stats_attrs, as parsed by genltest_stats_parse().
+ * Scalars are already in their own types, the rest point into the message.
+ * present has the bit of the type of each attribute that was found, see
+ * genltest_stats_has().
+ */
+struct genltest_stats_tb {
+	__u64  present;
+	__u64  echo;
+	__u64  mc_sent;
+	__u64  mc_nolisten;
+	__u64  mc_failed;
+	__u64  enomem;
+	__u64  emsgsize;
+	__u64  rx_bytes;
+	__u64  tx_bytes;
+	__u64  mc_coalesced;
+	__u64  mc_qfull;
+	__u64  mc_skipped;
+	__u64  ring_sent;
+	__u64  ring_dropped;
+	__u64  mc_throttled;
+	__u64  mc_waited;
+};
+
+#define genltest_stats_has(tb, type) (((tb)->present >> (type)) & 1)
+
+/*
+ * Parse the attributes of a message of genltest_stats_attrs, len bytes of them
+ * at attrs, into tb. Attributes have to be long enough for their type and
+ * strings NUL terminated, unknown ones are skipped. Returns 0, or -EINVAL if
+ * something is off.
+ */
+static inline int genltest_stats_parse(struct genltest_stats_tb *tb,
+				       const void *attrs, int len)
+{
+	const struct nlattr *nla;
+	int		     rem;
+
+	tb->present = 0;
+	genltest_nla_for_each(nla, attrs, len, rem) {
+		unsigned int type = nla->nla_type & NLA_TYPE_MASK;
+		const void  *data = genltest_nla_data(nla);
+		int	     n	  = genltest_nla_len(nla);
+
+		switch (type) {
+		case GENLTEST_STATS_A_ECHO:
+			if (n < (int)sizeof(__u64)) {
+				return -EINVAL;
+			}
+			/* Only 4 byte aligned without a pad */
+			memcpy(&tb->echo, data, sizeof(__u64));
+			break;
+		case GENLTEST_STATS_A_MC_SENT:
+			if (n < (int)sizeof(__u64)) {
+				return -EINVAL;
+			}
+			/* Only 4 byte aligned without a pad */
+			memcpy(&tb->mc_sent, data, sizeof(__u64));
+			break;
+		case GENLTEST_STATS_A_MC_NOLISTEN:
+			if (n < (int)sizeof(__u64)) {
+				return -EINVAL;
+			}
+			/* Only 4 byte aligned without a pad */
+			memcpy(&tb->mc_nolisten, data, sizeof(__u64));
+			break;
+		case GENLTEST_STATS_A_MC_FAILED:
+			if (n < (int)sizeof(__u64)) {
+				return -EINVAL;
+			}
+			/* Only 4 byte aligned without a pad */
+			memcpy(&tb->mc_failed, data, sizeof(__u64));
+			break;
+		case GENLTEST_STATS_A_ENOMEM:
+			if (n < (int)sizeof(__u64)) {
+				return -EINVAL;
+			}
+			/* Only 4 byte aligned without a pad */
+			memcpy(&tb->enomem, data, sizeof(__u64));
+			break;
+		case GENLTEST_STATS_A_EMSGSIZE:
+			if (n < (int)sizeof(__u64)) {
+				return -EINVAL;
+			}
+			/* Only 4 byte aligned without a pad */
+			memcpy(&tb->emsgsize, data, sizeof(__u64));
+			break;
+		case GENLTEST_STATS_A_RX_BYTES:
+			if (n < (int)sizeof(__u64)) {
+				return -EINVAL;
+			}
+			/* Only 4 byte aligned without a pad */
+			memcpy(&tb->rx_bytes, data, sizeof(__u64));
+			break;
+		case GENLTEST_STATS_A_TX_BYTES:
+			if (n < (int)sizeof(__u64)) {
+				return -EINVAL;
+			}
+			/* Only 4 byte aligned without a pad */
+			memcpy(&tb->tx_bytes, data, sizeof(__u64));
+			break;
+		case GENLTEST_STATS_A_MC_COALESCED:
+			if (n < (int)sizeof(__u64)) {
+				return -EINVAL;
+			}
+			/* Only 4 byte aligned without a pad */
+			memcpy(&tb->mc_coalesced, data, sizeof(__u64));
+			break;
+		case GENLTEST_STATS_A_MC_QFULL:
+			if (n < (int)sizeof(__u64)) {
+				return -EINVAL;
+			}
+			/* Only 4 byte aligned without a pad */
+			memcpy(&tb->mc_qfull, data, sizeof(__u64));
+			break;
+		case GENLTEST_STATS_A_MC_SKIPPED:
+			if (n < (int)sizeof(__u64)) {
+				return -EINVAL;
+			}
+			/* Only 4 byte aligned without a pad */
+			memcpy(&tb->mc_skipped, data, sizeof(__u64));
+			break;
+		case GENLTEST_STATS_A_RING_SENT:
+			if (n < (int)sizeof(__u64)) {
+				return -EINVAL;
+			}
+			/* Only 4 byte aligned without a pad */
+			memcpy(&tb->ring_sent, data, sizeof(__u64));
+			break;
+		case GENLTEST_STATS_A_RING_DROPPED:
+			if (n < (int)sizeof(__u64)) {
+				return -EINVAL;
+			}
+			/* Only 4 byte aligned without a pad */
+			memcpy(&tb->ring_dropped, data, sizeof(__u64));
+			break;
+		case GENLTEST_STATS_A_MC_THROTTLED:
+			if (n < (int)sizeof(__u64)) {
+				return -EINVAL;
+			}
+			/* Only 4 byte aligned without a pad */
+			memcpy(&tb->mc_throttled, data, sizeof(__u64));
+			break;
+		case GENLTEST_STATS_A_MC_WAITED:
+			if (n < (int)sizeof(__u64)) {
+				return -EINVAL;
+			}
+			/* Only 4 byte aligned without a pad */
+			memcpy(&tb->mc_waited, data, sizeof(__u64));
+			break;
+		default:
+			continue;
+		}
+		tb->present |= 1ULL << type;
+	}
+
+	return 0;
+}
+
+/*
+ * Attributes of genltest_latency_attrs, as parsed by genltest_latency_parse().
+ * Scalars are already in their own types, the rest point into the message.
+ * present has the bit of the type of each attribute that was found, see
+ * genltest_latency_has().
+ */
+struct genltest_latency_tb {
+	__u64		     present;
+	const char	    *stage;
+	__u64		     count;
+	__u64		     sum;
+	const struct nlattr *buckets;
+};
+
+#define genltest_latency_has(tb, type) (((tb)->present >> (type)) & 1)
+
+/*
+ * Parse the attributes of a message of genltest_latency_attrs, len bytes of
+ * them at attrs, into tb. Attributes have to be long enough for their type and
+ * strings NUL terminated, unknown ones are skipped. Returns 0, or -EINVAL if
+ * something is off.
+ */
+static inline int genltest_latency_parse(struct genltest_latency_tb *tb,
+					 const void *attrs, int len)
+{
+	const struct nlattr *nla;
+	int		     rem;
+
+	tb->present = 0;
+	genltest_nla_for_each(nla, attrs, len, rem) {
+		unsigned int type = nla->nla_type & NLA_TYPE_MASK;
+		const void  *data = genltest_nla_data(nla);
+		int	     n	  = genltest_nla_len(nla);
+
+		switch (type) {
+		case GENLTEST_LATENCY_A_STAGE:
+			if (n < 1 || ((const char *)data)[n - 1]) {
+				return -EINVAL;
+			}
+			tb->stage = data;
+			break;
+		case GENLTEST_LATENCY_A_COUNT:
+			if (n < (int)sizeof(__u64)) {
+				return -EINVAL;
+			}
+			/* Only 4 byte aligned without a pad */
+			memcpy(&tb->count, data, sizeof(__u64));
+			break;
+		case GENLTEST_LATENCY_A_SUM:
+			if (n < (int)sizeof(__u64)) {
+				return -EINVAL;
+			}
+			/* Only 4 byte aligned without a pad */
+			memcpy(&tb->sum, data, sizeof(__u64));
+			break;
+		case GENLTEST_LATENCY_A_BUCKETS:
+			tb->buckets = nla;
+			break;
+		default:
+			continue;
+		}
+		tb->present |= 1ULL << type;
+	}
+
+	return 0;
+}
+
+/*
+ * Encoders of the attributes of genltest_attrs into the message at nlh, in a
+ * buffer of size bytes. They return 0, or -EMSGSIZE if the attribute doesn't
+ * fit.
+ */
+static inline int genltest_put_msg(struct nlmsghdr *nlh, size_t size,
+				   const char *str)
+{
+	size_t len = strlen(str) + 1;
+	void  *p   = genltest_nla_reserve(nlh, size, GENLTEST_A_MSG, len);
+
+	if (!p) {
+		return -EMSGSIZE;
+	}
+	memcpy(p, str, len);
+
+	return 0;
+}
+
+static inline int genltest_put_count(struct nlmsghdr *nlh, size_t size,
+				     __u32 val)
+{
+	void *p = genltest_nla_reserve(nlh, size, GENLTEST_A_COUNT,
+				       sizeof(val));
+
+	if (!p) {
+		return -EMSGSIZE;
+	}
+	memcpy(p, &val, sizeof(val));
+
+	return 0;
+}
+
+static inline int genltest_put_seq(struct nlmsghdr *nlh, size_t size, __u32 val)
+{
+	void *p = genltest_nla_reserve(nlh, size, GENLTEST_A_SEQ, sizeof(val));
+
+	if (!p) {
+		return -EMSGSIZE;
+	}
+	memcpy(p, &val, sizeof(val));
+
+	return 0;
+}
+
+static inline int genltest_put_data(struct nlmsghdr *nlh, size_t size,
+				    const void *data, size_t len)
+{
+	void *p = genltest_nla_reserve(nlh, size, GENLTEST_A_DATA, len);
+
+	if (!p) {
+		return -EMSGSIZE;
+	}
+	memcpy(p, data, len);
+
+	return 0;
+}
+
+static inline int genltest_put_mcgrp(struct nlmsghdr *nlh, size_t size,
+				     __u32 val)
+{
+	void *p = genltest_nla_reserve(nlh, size, GENLTEST_A_MCGRP,
+				       sizeof(val));
+
+	if (!p) {
+		return -EMSGSIZE;
+	}
+	memcpy(p, &val, sizeof(val));
+
+	return 0;
+}
+
+static inline int genltest_put_ring_groups(struct nlmsghdr *nlh, size_t size,
+					   __u32 val)
+{
+	void *p = genltest_nla_reserve(nlh, size, GENLTEST_A_RING_GROUPS,
+				       sizeof(val));
+
+	if (!p) {
+		return -EMSGSIZE;
+	}
+	memcpy(p, &val, sizeof(val));
+
+	return 0;
+}
+
+static inline int genltest_put_ring_size(struct nlmsghdr *nlh, size_t size,
+					 __u32 val)
+{
+	void *p = genltest_nla_reserve(nlh, size, GENLTEST_A_RING_SIZE,
+				       sizeof(val));
+
+	if (!p) {
+		return -EMSGSIZE;
+	}
+	memcpy(p, &val, sizeof(val));
+
+	return 0;
+}
+
+static inline int genltest_put_ring_count(struct nlmsghdr *nlh, size_t size,
+					  __u32 val)
+{
+	void *p = genltest_nla_reserve(nlh, size, GENLTEST_A_RING_COUNT,
+				       sizeof(val));
+
+	if (!p) {
+		return -EMSGSIZE;
+	}
+	memcpy(p, &val, sizeof(val));
+
+	return 0;
+}
+
+static inline int genltest_put_ring_dropped(struct nlmsghdr *nlh, size_t size,
+					    __u64 val)
+{
+	void *p = genltest_nla_reserve(nlh, size, GENLTEST_A_RING_DROPPED,
+				       sizeof(val));
+
+	if (!p) {
+		return -EMSGSIZE;
+	}
+	memcpy(p, &val, sizeof(val));
+
+	return 0;
+}
+
+static inline int genltest_put_ring_index(struct nlmsghdr *nlh, size_t size,
+					  __u32 val)
+{
+	void *p = genltest_nla_reserve(nlh, size, GENLTEST_A_RING_INDEX,
+				       sizeof(val));
+
+	if (!p) {
+		return -EMSGSIZE;
+	}
+	memcpy(p, &val, sizeof(val));
+
+	return 0;
+}
+
+static inline int genltest_put_noreply(struct nlmsghdr *nlh, size_t size)
+{
+	return genltest_nla_reserve(nlh, size, GENLTEST_A_NOREPLY,
+				    0) ? 0 : -EMSGSIZE;
+}
+
+/* Names of the attributes of genltest_stats_attrs */
+static const char *const genltest_stats_names[GENLTEST_STATS_A_MAX + 1] = {
+	[GENLTEST_STATS_A_ECHO]		= "echo",
+	[GENLTEST_STATS_A_MC_SENT]	= "mc_sent",
+	[GENLTEST_STATS_A_MC_NOLISTEN]	= "mc_nolisten",
+	[GENLTEST_STATS_A_MC_FAILED]	= "mc_failed",
+	[GENLTEST_STATS_A_ENOMEM]	= "enomem",
+	[GENLTEST_STATS_A_EMSGSIZE]	= "emsgsize",
+	[GENLTEST_STATS_A_RX_BYTES]	= "rx_bytes",
+	[GENLTEST_STATS_A_TX_BYTES]	= "tx_bytes",
+	[GENLTEST_STATS_A_MC_COALESCED] = "mc_coalesced",
+	[GENLTEST_STATS_A_MC_QFULL]	= "mc_qfull",
+	[GENLTEST_STATS_A_MC_SKIPPED]	= "mc_skipped",
+	[GENLTEST_STATS_A_RING_SENT]	= "ring_sent",
+	[GENLTEST_STATS_A_RING_DROPPED] = "ring_dropped",
+	[GENLTEST_STATS_A_MC_THROTTLED] = "mc_throttled",
+	[GENLTEST_STATS_A_MC_WAITED]	= "mc_waited",
+};
+
+#endif /* GENLTEST_NL_USER_H */
@@ -0,0 +1,286 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Generic Netlink example program, without libnl
+ *
+ * The same echoes as genltest, but straight over an AF_NETLINK socket. The
+ * headers are laid out by hand into buffers on the stack, and the attributes
+ * by the encoders generated from the spec of the family, which also generates
+ * the parser of the replies, all in genltest_nl_user.h. Nothing is allocated,
+ * there are no callbacks and there is no attribute validation besides lengths
+ * and bounds, which is what most of the time goes into with libnl when echoing
+ * at high rates. And it doesn't need libnl to run either.
+ *
+ *  Copyright (c) 2022 Yaroslav de la Peña Smirnov <yps@yaroslavps.com>
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+
+#include "../ks/genltest.h"
+#include "genltest_nl_user.h"
+
+#define prerr(...) fprintf(stderr, "error: " __VA_ARGS__)
+
+/* What we send to GENLTEST_CMD_ECHO */
+#define ECHO_MSG "Hello from User Space, Netlink!"
+
+/*
+ * Room for the replies. Only the fixed reply to a string is expected, so a
+ * page is plenty, anything bigger is reported as truncated.
+ */
+#define RAW_BUF_LEN 4096
+
+/* A netlink socket and what libnl would otherwise keep track of for us */
+struct raw_sock {
+	int	 fd;
+	uint32_t portid;
+	uint32_t seq;
+};
+
+static int raw_open(struct raw_sock *rs)
+{
+	struct sockaddr_nl addr = { .nl_family = AF_NETLINK };
+	socklen_t	   len	= sizeof(addr);
+
+	rs->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+	if (rs->fd < 0) {
+		return -errno;
+	}
+
+	/* Let the kernel pick the portid, and find out which one it was */
+	if (bind(rs->fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    getsockname(rs->fd, (struct sockaddr *)&addr, &len)) {
+		close(rs->fd);
+		return -errno;
+	}
+	rs->portid = addr.nl_pid;
+	rs->seq	   = time(NULL);
+
+	return 0;
+}
+
+/*
+ * Start a genl message in buf, with the netlink and genl headers. Attributes
+ * then go after them with the encoders of genltest_nl_user.h.
+ */
+static struct nlmsghdr *raw_msg(struct raw_sock *rs, void *buf, uint16_t type,
+				uint8_t cmd, uint8_t version)
+{
+	struct nlmsghdr	  *nlh	   = buf;
+	struct genlmsghdr *genlhdr = NLMSG_DATA(nlh);
+
+	*nlh = (struct nlmsghdr){
+		.nlmsg_len   = NLMSG_LENGTH(GENL_HDRLEN),
+		.nlmsg_type  = type,
+		.nlmsg_flags = NLM_F_REQUEST,
+		.nlmsg_seq   = ++rs->seq,
+		.nlmsg_pid   = rs->portid,
+	};
+	*genlhdr = (struct genlmsghdr){ .cmd = cmd, .version = version };
+
+	return nlh;
+}
+
+static int raw_send(struct raw_sock *rs, struct nlmsghdr *nlh)
+{
+	struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+
+	if (sendto(rs->fd, nlh, nlh->nlmsg_len, 0, (struct sockaddr *)&kernel,
+		   sizeof(kernel)) < 0) {
+		return -errno;
+	}
+
+	return 0;
+}
+
+/*
+ * Receive the reply to the last request sent into buf. Returns the message,
+ * or NULL with err set to what went wrong, including the errors reported by
+ * the kernel itself.
+ */
+static struct nlmsghdr *raw_recv(struct raw_sock *rs, void *buf, int *err)
+{
+	while (1) {
+		struct nlmsghdr *nlh;
+		int len = recv(rs->fd, buf, RAW_BUF_LEN, MSG_TRUNC);
+
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			*err = -errno;
+			return NULL;
+		}
+		if (len > RAW_BUF_LEN) {
+			*err = -EMSGSIZE;
+			return NULL;
+		}
+
+		for (nlh = buf; NLMSG_OK(nlh, len);
+		     nlh = NLMSG_NEXT(nlh, len)) {
+			/* Some late reply to a request that we gave up on */
+			if (nlh->nlmsg_seq != rs->seq) {
+				continue;
+			}
+			if (nlh->nlmsg_type == NLMSG_ERROR) {
+				struct nlmsgerr *e = NLMSG_DATA(nlh);
+
+				*err = e->error ? e->error : -ENOMSG;
+				return NULL;
+			}
+			return nlh;
+		}
+	}
+}
+
+/*
+ * Ask nlctrl for the id of our family. Just the id, the groups are of no use
+ * to us.
+ */
+static int raw_resolve(struct raw_sock *rs)
+{
+	char buf[RAW_BUF_LEN] __attribute__((aligned(NLMSG_ALIGNTO)));
+	struct nlmsghdr	    *nlh;
+	const struct nlattr *nla;
+	void		    *name;
+	int		     err, rem;
+
+	/* nlctrl is not in our spec, its attribute is put in by hand */
+	nlh  = raw_msg(rs, buf, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 1);
+	name = genltest_nla_reserve(nlh, sizeof(buf), CTRL_ATTR_FAMILY_NAME,
+				    sizeof(GENLTEST_GENL_NAME));
+	memcpy(name, GENLTEST_GENL_NAME, sizeof(GENLTEST_GENL_NAME));
+	if ((err = raw_send(rs, nlh))) {
+		return err;
+	}
+	if (!(nlh = raw_recv(rs, buf, &err))) {
+		return err;
+	}
+
+	genltest_nla_for_each(nla, genltest_attrs(nlh), genltest_attrs_len(nlh),
+			      rem) {
+		if ((nla->nla_type & NLA_TYPE_MASK) == CTRL_ATTR_FAMILY_ID &&
+		    nla->nla_len == NLA_HDRLEN + sizeof(uint16_t)) {
+			return *(const uint16_t *)genltest_nla_data(nla);
+		}
+	}
+
+	return -ENOENT;
+}
+
+/*
+ * The string of GENLTEST_A_MSG in a reply, or NULL if there's none or it isn't
+ * valid.
+ */
+static const char *raw_parse_msg(struct nlmsghdr *nlh)
+{
+	struct genltest_tb tb = { 0 };
+
+	if (genltest_parse(&tb, genltest_attrs(nlh), genltest_attrs_len(nlh)) ||
+	    !genltest_has(&tb, GENLTEST_A_MSG)) {
+		return NULL;
+	}
+
+	return tb.msg;
+}
+
+/*
+ * Send GENLTEST_CMD_ECHO with ECHO_MSG and receive the reply. There's no ACK
+ * asked for, the reply alone tells that it went through. Returns the string
+ * in the reply, or NULL with err set.
+ */
+static const char *raw_echo(struct raw_sock *rs, uint16_t fam, void *buf,
+			    int *err)
+{
+	char		 req[NLMSG_LENGTH(GENL_HDRLEN) + NLA_HDRLEN +
+			     NLA_ALIGN(sizeof(ECHO_MSG))]
+		__attribute__((aligned(NLMSG_ALIGNTO)));
+	struct nlmsghdr *nlh;
+	const char	*reply;
+
+	nlh = raw_msg(rs, req, fam, GENLTEST_CMD_ECHO, GENLTEST_GENL_VERSION);
+	genltest_put_msg(nlh, sizeof(req), ECHO_MSG);
+	if ((*err = raw_send(rs, nlh))) {
+		return NULL;
+	}
+	if (!(nlh = raw_recv(rs, buf, err))) {
+		return NULL;
+	}
+	if (nlh->nlmsg_type != fam || !(reply = raw_parse_msg(nlh))) {
+		*err = -EBADMSG;
+		return NULL;
+	}
+
+	return reply;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n count]\n"
+		"  -n count  echoes to send, only the rate is printed if more "
+		"than one\n",
+		prog);
+}
+
+int main(int argc, char *argv[])
+{
+	char buf[RAW_BUF_LEN] __attribute__((aligned(NLMSG_ALIGNTO)));
+	int		opt, fam, err = 0;
+	unsigned int	count = 1, done = 0;
+	const char     *reply;
+	struct raw_sock rs;
+	struct timespec start, end;
+
+	while ((opt = getopt(argc, argv, "n:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if ((err = raw_open(&rs))) {
+		prerr("failed to open netlink socket: %s\n", strerror(-err));
+		return 1;
+	}
+	if ((fam = raw_resolve(&rs)) < 0) {
+		prerr("failed to resolve generic netlink family: %s\n",
+		      strerror(-fam));
+		close(rs.fd);
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (; done < count; done++) {
+		if (!(reply = raw_echo(&rs, fam, buf, &err))) {
+			prerr("echo failed: %s\n", strerror(-err));
+			break;
+		}
+		if (count == 1) {
+			printf("message received: %s\n", reply);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (count > 1) {
+		double elapsed = (end.tv_sec - start.tv_sec) +
+				 (end.tv_nsec - start.tv_nsec) / 1e9;
+
+		printf("%u echoes in %.3f s, %.0f echo/s\n", done, elapsed,
+		       elapsed > 0 ? done / elapsed : 0);
+	}
+	close(rs.fd);
+
+	return done == count ? 0 : 1;
+}
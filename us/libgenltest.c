@@ -0,0 +1,602 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Generic Netlink example client library
+ *
+ * See libgenltest.h for what it does and how to use it.
+ *
+ *  Copyright (c) 2022 Yaroslav de la Peña Smirnov <yps@yaroslavps.com>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <linux/genetlink.h>
+#include <netlink/socket.h>
+#include <netlink/netlink.h>
+#include <netlink/genl/ctrl.h>
+#include <netlink/genl/genl.h>
+
+#include "../ks/genltest.h"
+#include "libgenltest.h"
+#include "genltest_nl_user.h"
+
+/*
+ * Where the resolved family is cached between runs. /run is gone after a
+ * reboot, and so are the ids of the family and its groups.
+ */
+#define FAM_CACHE_PATH "/run/genltest.cache"
+
+/*
+ * Random number that the module picks each time that it's loaded, i.e. each
+ * time that the family is registered. The cache is only good for the instance
+ * that it was written for: once reloaded, the family and its groups may well
+ * get the same ids back, or ids that some other family had.
+ */
+#define FAM_INSTANCE_PATH "/sys/" GENLTEST_GENL_NAME "/instance"
+
+/* Multicast groups of the family that we keep track of */
+#define FAM_MAX_GRPS 16
+
+/*
+ * All of the ctrl notifications go to the "notify" group of nlctrl, whose id
+ * is always GENL_ID_CTRL.
+ */
+#define CTRL_NOTIFY_GRP GENL_ID_CTRL
+
+/*
+ * Size of the messages of the pool, enough for the biggest request that we
+ * send through it, an echo of GENLTEST_DATA_MAX_LEN bytes of data, plus a flag
+ * like GENLTEST_A_NOREPLY.
+ */
+#define POOL_MSG_LEN                                                           \
+	(NLMSG_HDRLEN + GENL_HDRLEN + NLA_HDRLEN + GENLTEST_DATA_MAX_LEN +     \
+	 NLA_HDRLEN)
+
+/* What we need to know about our family to talk to it */
+struct fam_info {
+	uint64_t     instance;
+	int	     id;
+	uint32_t     version;
+	unsigned int ngrps;
+	struct fam_grp {
+		char	 name[GENL_NAMSIZ];
+		uint32_t id;
+	}	     grps[FAM_MAX_GRPS];
+};
+
+/* Parse the reply to CTRL_CMD_GETFAMILY, the id, version and groups */
+static int fam_info_handler(struct nl_msg *msg, void *arg)
+{
+	struct fam_info	  *info	   = arg;
+	struct genlmsghdr *genlhdr = nlmsg_data(nlmsg_hdr(msg));
+	struct nlattr	  *tb[CTRL_ATTR_MAX + 1], *nla;
+	int		   rem;
+
+	if (nla_parse(tb, CTRL_ATTR_MAX, genlmsg_attrdata(genlhdr, 0),
+		      genlmsg_attrlen(genlhdr, 0), NULL) ||
+	    !tb[CTRL_ATTR_FAMILY_ID]) {
+		return NL_SKIP;
+	}
+	info->id      = nla_get_u16(tb[CTRL_ATTR_FAMILY_ID]);
+	info->version = tb[CTRL_ATTR_VERSION] ?
+				nla_get_u32(tb[CTRL_ATTR_VERSION]) :
+				0;
+	if (!tb[CTRL_ATTR_MCAST_GROUPS]) {
+		return NL_OK;
+	}
+	nla_for_each_nested(nla, tb[CTRL_ATTR_MCAST_GROUPS], rem) {
+		struct nlattr  *gtb[CTRL_ATTR_MCAST_GRP_MAX + 1];
+		struct fam_grp *g = &info->grps[info->ngrps];
+
+		if (info->ngrps == FAM_MAX_GRPS) {
+			break;
+		}
+		if (nla_parse_nested(gtb, CTRL_ATTR_MCAST_GRP_MAX, nla, NULL) ||
+		    !gtb[CTRL_ATTR_MCAST_GRP_NAME] ||
+		    !gtb[CTRL_ATTR_MCAST_GRP_ID]) {
+			continue;
+		}
+		nla_strlcpy(g->name, gtb[CTRL_ATTR_MCAST_GRP_NAME],
+			    sizeof(g->name));
+		g->id = nla_get_u32(gtb[CTRL_ATTR_MCAST_GRP_ID]);
+		info->ngrps++;
+	}
+
+	return NL_OK;
+}
+
+/*
+ * Resolve the family and all of its groups with a single CTRL_CMD_GETFAMILY
+ * round trip, instead of one for the family and another one for each group
+ * like genl_ctrl_resolve() and genl_ctrl_resolve_grp() do. It goes through a
+ * socket of its own, so that it can't get mixed up with whatever a handle has
+ * in flight when it has to resolve the family again.
+ */
+static int fam_query(struct fam_info *info)
+{
+	int		err;
+	struct nl_msg  *msg = NULL;
+	struct nl_sock *sk  = nl_socket_alloc();
+	if (!sk) {
+		return -NLE_NOMEM;
+	}
+
+	if ((err = genl_connect(sk))) {
+		goto out;
+	}
+	msg = nlmsg_alloc();
+	if (!msg) {
+		err = -NLE_NOMEM;
+		goto out;
+	}
+	if (!genlmsg_put(msg, NL_AUTO_PORT, NL_AUTO_SEQ, GENL_ID_CTRL, 0, 0,
+			 CTRL_CMD_GETFAMILY, 1) ||
+	    nla_put_string(msg, CTRL_ATTR_FAMILY_NAME,
+			   GENLTEST_GENL_NAME) < 0) {
+		err = -NLE_MSGSIZE;
+		goto out;
+	}
+
+	memset(info, 0, sizeof(*info));
+	info->id = -1;
+	if ((err = nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
+				       fam_info_handler, info))) {
+		goto out;
+	}
+	if ((err = nl_send_auto(sk, msg)) >= 0 &&
+	    (err = nl_recvmsgs_default(sk)) >= 0 &&
+	    (err = nl_wait_for_ack(sk)) >= 0) {
+		err = info->id < 0 ? -NLE_OBJ_NOTFOUND : 0;
+	}
+
+out:
+	nlmsg_free(msg);
+	nl_socket_free(sk);
+
+	return err;
+}
+
+/* Instance of the module loaded right now, 0 if there's no telling */
+static uint64_t fam_instance(void)
+{
+	unsigned long long instance;
+	FILE		  *f = fopen(FAM_INSTANCE_PATH, "r");
+
+	if (!f) {
+		return 0;
+	}
+	if (fscanf(f, "%llu", &instance) != 1) {
+		instance = 0;
+	}
+	fclose(f);
+
+	return instance;
+}
+
+/*
+ * Read the cached family, only good if it's of the version we speak and was
+ * written for the instance of the module that is loaded.
+ */
+static int fam_cache_load(struct fam_info *info, uint64_t instance)
+{
+	int		   ret = -1;
+	unsigned long long cached;
+	FILE		  *f;
+
+	if (!instance || !(f = fopen(FAM_CACHE_PATH, "r"))) {
+		return -1;
+	}
+	memset(info, 0, sizeof(*info));
+	if (fscanf(f, "%llu %u %d %u", &cached, &info->version, &info->id,
+		   &info->ngrps) != 4 ||
+	    cached != instance || info->version != GENLTEST_GENL_VERSION ||
+	    info->ngrps > FAM_MAX_GRPS) {
+		goto out;
+	}
+	info->instance = instance;
+	for (unsigned int i = 0; i < info->ngrps; i++) {
+		if (fscanf(f, "%15s %u", info->grps[i].name,
+			   &info->grps[i].id) != 2) {
+			goto out;
+		}
+	}
+	ret = 0;
+
+out:
+	fclose(f);
+	return ret;
+}
+
+/*
+ * Cache the family for the next runs. Best effort: if /run can't be written
+ * to, the next run just resolves the family again. The file is replaced as a
+ * whole, so that concurrent runs never read a half written one. It's readable
+ * by everyone, like the ids it holds, so that runs as other users use it too.
+ */
+static void fam_cache_store(const struct fam_info *info)
+{
+	char  tmp[] = FAM_CACHE_PATH ".XXXXXX";
+	int   fd    = mkstemp(tmp);
+	FILE *f;
+
+	if (fd < 0) {
+		return;
+	}
+	/* mkstemp() only lets the owner in */
+	if (fchmod(fd, 0644) || !(f = fdopen(fd, "w"))) {
+		close(fd);
+		unlink(tmp);
+		return;
+	}
+	fprintf(f, "%llu %u %d %u\n", (unsigned long long)info->instance,
+		info->version, info->id, info->ngrps);
+	for (unsigned int i = 0; i < info->ngrps; i++) {
+		fprintf(f, "%s %u\n", info->grps[i].name, info->grps[i].id);
+	}
+	if (fclose(f) || rename(tmp, FAM_CACHE_PATH)) {
+		unlink(tmp);
+	}
+}
+
+/* The module went away or came back, whatever was cached is no good */
+static inline void fam_cache_drop(void)
+{
+	unlink(FAM_CACHE_PATH);
+}
+
+/*
+ * Resolve the family, from the cache if possible. The instance is read before
+ * asking the kernel, so that a reload in between can only leave behind a cache
+ * of an instance that is already gone, which nobody trusts.
+ */
+static int fam_resolve(struct fam_info *info)
+{
+	int	 err;
+	uint64_t instance = fam_instance();
+
+	if (!fam_cache_load(info, instance)) {
+		return 0;
+	}
+	if ((err = fam_query(info))) {
+		return err;
+	}
+	info->instance = instance;
+	if (instance) {
+		fam_cache_store(info);
+	}
+
+	return 0;
+}
+
+/* Id of the multicast group called name */
+static int fam_grp(const struct fam_info *info, const char *name)
+{
+	for (unsigned int i = 0; i < info->ngrps; i++) {
+		if (!strcmp(info->grps[i].name, name)) {
+			return info->grps[i].id;
+		}
+	}
+
+	return -NLE_OBJ_NOTFOUND;
+}
+
+/*
+ * The family as resolved by the first handle opened by the process, which the
+ * rest of them then reuse. It's only resolved again once forgotten, or once
+ * the module loaded is not the one that it was resolved from.
+ */
+static pthread_mutex_t fam_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct fam_info fam_cur;
+static bool	       fam_known;
+
+static int fam_get(struct fam_info *info)
+{
+	int err = 0;
+
+	pthread_mutex_lock(&fam_lock);
+	if (!fam_known || fam_instance() != fam_cur.instance) {
+		err	  = fam_resolve(&fam_cur);
+		fam_known = !err;
+	}
+	if (!err) {
+		*info = fam_cur;
+	}
+	pthread_mutex_unlock(&fam_lock);
+
+	return err;
+}
+
+void genltest_forget(void)
+{
+	pthread_mutex_lock(&fam_lock);
+	fam_known = false;
+	pthread_mutex_unlock(&fam_lock);
+	fam_cache_drop();
+}
+
+int genltest_ctrl_notify(struct nlmsghdr *nlh)
+{
+	struct genlmsghdr *genlhdr = nlmsg_data(nlh);
+	struct nlattr	  *tb[CTRL_ATTR_MAX + 1];
+
+	/*
+	 * When our family is unregistered or registered again, i.e. the module
+	 * was reloaded, the ids that we know of are stale.
+	 */
+	if (genlhdr->cmd != CTRL_CMD_NEWFAMILY &&
+	    genlhdr->cmd != CTRL_CMD_DELFAMILY) {
+		return 0;
+	}
+	if (nla_parse(tb, CTRL_ATTR_MAX, genlmsg_attrdata(genlhdr, 0),
+		      genlmsg_attrlen(genlhdr, 0), NULL) ||
+	    !tb[CTRL_ATTR_FAMILY_NAME] ||
+	    strcmp(nla_get_string(tb[CTRL_ATTR_FAMILY_NAME]),
+		   GENLTEST_GENL_NAME)) {
+		return 0;
+	}
+	genltest_forget();
+
+	return 1;
+}
+
+struct genltest {
+	struct nl_sock *sk;
+	struct fam_info fam;
+	/* The groups joined, by name, to join them again if their ids change */
+	unsigned int	nsubs;
+	char		subs[FAM_MAX_GRPS][GENL_NAMSIZ];
+	/* The messages of the pool that are not in use, a stack of them */
+	unsigned int	nfree;
+	struct nl_msg  *pool[GENLTEST_POOL_LEN];
+};
+
+/*
+ * Have errors come with the extended ACK of the kernel, i.e. with a message
+ * telling what went wrong, and without a copy of the whole request that they
+ * belong to. Kernels older than that just don't, so failing is fine.
+ */
+static void set_ext_ack(struct nl_sock *sk)
+{
+	int one = 1, fd = nl_socket_get_fd(sk);
+
+	setsockopt(fd, SOL_NETLINK, NETLINK_EXT_ACK, &one, sizeof(one));
+	setsockopt(fd, SOL_NETLINK, NETLINK_CAP_ACK, &one, sizeof(one));
+}
+
+int genltest_open(struct genltest **gtp)
+{
+	int		 err;
+	struct genltest *gt = calloc(1, sizeof(*gt));
+	if (!gt) {
+		return -NLE_NOMEM;
+	}
+
+	gt->sk = nl_socket_alloc();
+	if (!gt->sk) {
+		err = -NLE_NOMEM;
+		goto err;
+	}
+
+	/*
+	 * By default libnl receives into a single page, anything bigger than
+	 * that would be truncated (MSG_TRUNC) unless it peeks first.
+	 */
+	nl_socket_set_msg_buf_size(gt->sk, GENLTEST_MSG_BUF_LEN);
+	if ((err = genl_connect(gt->sk)) || (err = fam_get(&gt->fam))) {
+		goto err;
+	}
+	set_ext_ack(gt->sk);
+
+	/* All of the allocations are done here, and none while sending */
+	for (; gt->nfree < GENLTEST_POOL_LEN; gt->nfree++) {
+		gt->pool[gt->nfree] = nlmsg_alloc_size(POOL_MSG_LEN);
+		if (!gt->pool[gt->nfree]) {
+			err = -NLE_NOMEM;
+			goto err;
+		}
+	}
+
+	*gtp = gt;
+	return 0;
+
+err:
+	genltest_close(gt);
+	return err;
+}
+
+void genltest_close(struct genltest *gt)
+{
+	/* Messages still taken from the pool are the caller's to put back */
+	for (unsigned int i = 0; i < gt->nfree; i++) {
+		nlmsg_free(gt->pool[i]);
+	}
+	if (gt->sk) {
+		nl_close(gt->sk);
+		nl_socket_free(gt->sk);
+	}
+	free(gt);
+}
+
+struct nl_sock *genltest_sock(struct genltest *gt)
+{
+	return gt->sk;
+}
+
+int genltest_family(const struct genltest *gt)
+{
+	return gt->fam.id;
+}
+
+struct nl_msg *genltest_msg(struct genltest *gt, uint8_t cmd, int flags,
+			    uint32_t seq)
+{
+	struct nl_msg *msg;
+
+	if (!gt->nfree) {
+		return NULL;
+	}
+	msg = gt->pool[--gt->nfree];
+
+	/*
+	 * Empty it for reuse. libnl appends after the length in the header,
+	 * so going back to just the header is all that it takes, and the genl
+	 * header then goes right after it.
+	 */
+	nlmsg_hdr(msg)->nlmsg_len = NLMSG_HDRLEN;
+	if (!genlmsg_put(msg, NL_AUTO_PORT, seq, gt->fam.id, 0, flags, cmd,
+			 GENLTEST_GENL_VERSION)) {
+		genltest_msg_put(gt, msg);
+		return NULL;
+	}
+
+	return msg;
+}
+
+void genltest_msg_put(struct genltest *gt, struct nl_msg *msg)
+{
+	gt->pool[gt->nfree++] = msg;
+}
+
+int genltest_send(struct genltest *gt, struct nl_msg *msg)
+{
+	/* The message is copied by the kernel, it can be reused right away */
+	int err = nl_send_auto(gt->sk, msg);
+
+	genltest_msg_put(gt, msg);
+
+	return err >= 0 ? 0 : err;
+}
+
+int genltest_echo(struct genltest *gt, const char *str, uint32_t seq)
+{
+	struct nl_msg *msg = genltest_msg(gt, GENLTEST_CMD_ECHO, 0, seq);
+	if (!msg) {
+		return -NLE_NOMEM;
+	}
+
+	/* Written in place by the encoder generated from the spec */
+	if (genltest_put_msg(nlmsg_hdr(msg), nlmsg_get_max_size(msg), str)) {
+		genltest_msg_put(gt, msg);
+		return -NLE_MSGSIZE;
+	}
+
+	return genltest_send(gt, msg);
+}
+
+int genltest_echo_data(struct genltest *gt, const void *data, size_t len,
+		       uint32_t seq)
+{
+	struct nl_msg *msg = genltest_msg(gt, GENLTEST_CMD_ECHO, 0, seq);
+	if (!msg) {
+		return -NLE_NOMEM;
+	}
+
+	/*
+	 * Unlike strings, there's no NUL to append on our side nor to look for
+	 * on the kernel side.
+	 */
+	if (genltest_put_data(nlmsg_hdr(msg), nlmsg_get_max_size(msg), data,
+			      len)) {
+		genltest_msg_put(gt, msg);
+		return -NLE_MSGSIZE;
+	}
+
+	return genltest_send(gt, msg);
+}
+
+int genltest_sync(struct genltest *gt)
+{
+	struct fam_info info;
+	int		err;
+
+	if ((err = fam_get(&info))) {
+		return err;
+	}
+
+	/*
+	 * Memberships of the groups of a family that is gone are gone too, even
+	 * if the groups came back with the same ids, so join all of them again.
+	 */
+	for (unsigned int i = 0; i < gt->nsubs; i++) {
+		int old = fam_grp(&gt->fam, gt->subs[i]);
+		int new = fam_grp(&info, gt->subs[i]);
+
+		if (old >= 0 && old != new) {
+			nl_socket_drop_membership(gt->sk, old);
+		}
+		if (new >= 0 && (err = nl_socket_add_membership(gt->sk, new))) {
+			return err;
+		}
+	}
+	gt->fam = info;
+
+	return 0;
+}
+
+int genltest_recover(struct genltest *gt, int err)
+{
+	/*
+	 * What the kernel says when there's no family with our id, or when the
+	 * one with it doesn't have the command, i.e. it's some other family.
+	 */
+	if (err != -NLE_OBJ_NOTFOUND && err != -NLE_OPNOTSUPP) {
+		return 0;
+	}
+	genltest_forget();
+
+	return !genltest_sync(gt);
+}
+
+int genltest_subscribe(struct genltest *gt, const char *name)
+{
+	int err, grp;
+
+	/* Make sure that the ids are those of the module loaded right now */
+	if ((err = genltest_sync(gt))) {
+		return err;
+	}
+	if ((grp = fam_grp(&gt->fam, name)) < 0) {
+		return grp;
+	}
+	if (gt->nsubs == FAM_MAX_GRPS) {
+		return -NLE_RANGE;
+	}
+	if ((err = nl_socket_add_membership(gt->sk, grp))) {
+		return err;
+	}
+	snprintf(gt->subs[gt->nsubs++], GENL_NAMSIZ, "%s", name);
+
+	return 0;
+}
+
+int genltest_watch(struct genltest *gt)
+{
+	return nl_socket_add_membership(gt->sk, CTRL_NOTIFY_GRP);
+}
+
+const char *genltest_ext_ack_msg(const struct nlmsgerr *err)
+{
+	const struct nlmsghdr *nlh = (const struct nlmsghdr *)err - 1;
+	struct nlattr	      *tb[NLMSGERR_ATTR_MAX + 1];
+	int		       off = sizeof(*err);
+
+	if (!(nlh->nlmsg_flags & NLM_F_ACK_TLVS)) {
+		return NULL;
+	}
+	/* The TLVs come after the request, unless it was left out */
+	if (!(nlh->nlmsg_flags & NLM_F_CAPPED)) {
+		off += err->msg.nlmsg_len - NLMSG_HDRLEN;
+	}
+	if (nla_parse(tb, NLMSGERR_ATTR_MAX,
+		      (struct nlattr *)((char *)err + off),
+		      nlh->nlmsg_len - NLMSG_HDRLEN - off, NULL) ||
+	    !tb[NLMSGERR_ATTR_MSG]) {
+		return NULL;
+	}
+
+	return nla_get_string(tb[NLMSGERR_ATTR_MSG]);
+}
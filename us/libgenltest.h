@@ -0,0 +1,121 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Generic Netlink example client library
+ *
+ * What the example program needs to talk to the genltest module, packed so
+ * that other programs can embed it instead of running the program.
+ *
+ * Each handle is a socket connected to Generic Netlink, the family already
+ * resolved, and a pool of messages preallocated big enough for any request,
+ * so that sending doesn't allocate anything. Like the libnl sockets that they
+ * wrap, handles are not meant to be shared between threads, open one for each
+ * thread instead. The family is only resolved once per process, and then
+ * cached across processes too, so that opening many of them is cheap. What's
+ * cached is only trusted for as long as the same instance of the module stays
+ * loaded.
+ *
+ * Unless told otherwise, functions return 0 or a negative libnl error code,
+ * which nl_geterror() can tell about.
+ *
+ *  Copyright (c) 2022 Yaroslav de la Peña Smirnov <yps@yaroslavps.com>
+ */
+#ifndef LIBGENLTEST_H
+#define LIBGENLTEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netlink/netlink.h>
+
+/*
+ * Receive buffer of the sockets of the handles. The payload of the biggest
+ * message that the module may send is limited to 64 KiB by the 16 bit length
+ * of attributes, the rest is room for the headers.
+ */
+#define GENLTEST_MSG_BUF_LEN (2 * 65536)
+
+/* Messages in the pool of each handle */
+#define GENLTEST_POOL_LEN 4
+
+struct genltest;
+
+/* Connect to Generic Netlink and resolve the family of the module */
+int genltest_open(struct genltest **gt);
+void genltest_close(struct genltest *gt);
+
+/*
+ * The libnl socket of the handle, to set callbacks on, receive replies or
+ * notifications from and so on.
+ */
+struct nl_sock *genltest_sock(struct genltest *gt);
+
+/* Id of the family of the module */
+int genltest_family(const struct genltest *gt);
+
+/*
+ * Send GENLTEST_CMD_ECHO with str, or with len bytes of binary data which the
+ * kernel echoes back as is. seq is the sequence number, NL_AUTO_SEQ to let
+ * libnl pick the next one. The reply is up to the caller to receive.
+ */
+int genltest_echo(struct genltest *gt, const char *str, uint32_t seq);
+int genltest_echo_data(struct genltest *gt, const void *data, size_t len,
+		       uint32_t seq);
+
+/*
+ * Take a message from the pool, with the genl header for cmd already in, to
+ * put attributes into. NULL if the pool is empty. It goes back to the pool
+ * once sent with genltest_send(), or with genltest_msg_put() if it's not sent
+ * after all.
+ */
+struct nl_msg *genltest_msg(struct genltest *gt, uint8_t cmd, int flags,
+			    uint32_t seq);
+void genltest_msg_put(struct genltest *gt, struct nl_msg *msg);
+int genltest_send(struct genltest *gt, struct nl_msg *msg);
+
+/*
+ * Join the multicast group of the module called name, after making sure that
+ * the ids of the handle are those of the module loaded right now.
+ */
+int genltest_subscribe(struct genltest *gt, const char *name);
+
+/*
+ * Bring the handle up to date with the family once forgotten, e.g. after
+ * genltest_ctrl_notify() said that the module was reloaded: resolve it again
+ * and join the groups that the handle joined under their new ids.
+ */
+int genltest_sync(struct genltest *gt);
+
+/*
+ * Look at an error got for a request sent on the handle. If it says that the
+ * ids of the handle are stale, forget them and sync the handle. Returns 1 if
+ * so, and the request is worth sending again, 0 otherwise.
+ */
+int genltest_recover(struct genltest *gt, int err);
+
+/*
+ * Also receive the notifications of nlctrl, which tell when the family comes
+ * and goes, i.e. when the module is reloaded. Messages of type GENL_ID_CTRL
+ * then need to be passed on to genltest_ctrl_notify().
+ */
+int genltest_watch(struct genltest *gt);
+
+/*
+ * Handle a notification of nlctrl. Returns 1 if it was about our family, in
+ * which case whatever was resolved of it is forgotten, 0 otherwise.
+ */
+int genltest_ctrl_notify(struct nlmsghdr *nlh);
+
+/*
+ * Forget the resolved family, e.g. because the module doesn't know the id any
+ * longer. Handles opened afterwards resolve it again, those already open once
+ * synced.
+ */
+void genltest_forget(void);
+
+/*
+ * The message of the extended ACK of an error received on a handle, as given
+ * to the error callback of libnl, or NULL if the kernel didn't say anything
+ * more than the error code.
+ */
+const char *genltest_ext_ack_msg(const struct nlmsgerr *err);
+
+#endif /* LIBGENLTEST_H */
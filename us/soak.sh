@@ -0,0 +1,65 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0
+#
+# Soak test of the module: build it and the program, load the module, run
+# `genltest soak` against the baseline with the skb leak check on, and unload
+# the module again. Exits with what the soak exits with, 2 if the module got
+# slower than the baseline or leaked skbs. Needs root, for insmod, the pings
+# and /proc/slabinfo.
+#
+#   ./soak.sh [soak options]...         soak and compare with the baseline
+#   ./soak.sh record [soak options]...  soak and save the run as the baseline
+#
+# SOAK_ARGS are the options of every run, so that a run and its baseline are
+# alike, BASELINE and MAX_SKBS where the baseline is and how many skbs a run
+# can leave behind.
+#
+# The baseline committed is not a measurement, it's a floor that any machine
+# able to soak the module should clear. Record one on the machine under test
+# to catch smaller slowdowns than that.
+
+set -e
+
+cd "$(dirname "$0")"
+
+BASELINE=${BASELINE:-soak-baseline.json}
+MAX_SKBS=${MAX_SKBS:-256}
+SOAK_ARGS=${SOAK_ARGS:--t 30 -c 2 -l 2 -p 2 -B 10000}
+
+record=
+if [ "$1" = record ]; then
+	record=1
+	shift
+fi
+
+make -C ../ks
+make
+
+# Whatever genltest is loaded, it's ours that is soaked
+if grep -q '^genltest ' /proc/modules; then
+	rmmod genltest
+fi
+insmod ../ks/genltest.ko
+trap 'rmmod genltest' EXIT
+
+status=0
+if [ -n "$record" ]; then
+	# shellcheck disable=SC2086
+	./genltest soak $SOAK_ARGS -L "$MAX_SKBS" -o json "$@" \
+		>"$BASELINE.new" || status=$?
+	if [ "$status" -eq 0 ]; then
+		mv "$BASELINE.new" "$BASELINE"
+		echo "baseline saved to $BASELINE"
+	else
+		rm -f "$BASELINE.new"
+	fi
+else
+	# shellcheck disable=SC2086
+	./genltest soak $SOAK_ARGS -b "$BASELINE" -L "$MAX_SKBS" "$@" ||
+		status=$?
+fi
+
+if [ "$status" -ne 0 ]; then
+	echo "SOAK FAILED with $status" >&2
+fi
+exit "$status"